@@ -0,0 +1,314 @@
+/* buffer_cache.c: Cache of file system disk sectors.
+ *
+ * Every sector of the file system disk is read and written through a
+ * cache of buffer_cache_size sectors.  A miss evicts a sector picked by
+ * the clock algorithm, writing it back first if it is dirty.  Dirty
+ * sectors are otherwise written behind, together with the free map,
+ * every WRITE_BEHIND_TICKS by buffer_cache_kworkerd and at
+ * filesys_done ().  Sectors queued by buffer_cache_readahead () are
+ * brought in ahead of use by buffer_cache_readaheadd, so a sequential
+ * reader finds the next sector already cached.
+ *
+ * This is separate from the page cache of page_cache.c, which caches
+ * file pages as VM pages. */
+
+#include "filesys/buffer_cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Ticks between two write-behind passes. */
+#define WRITE_BEHIND_TICKS (5 * TIMER_FREQ)
+
+/* Read-ahead requests that may be pending at once.  Later requests are
+ * dropped until the daemon catches up. */
+#define READAHEAD_QUEUE 16
+
+/* A cached sector.
+ * Disk I/O and copies to and from callers run without cache_lock.  An
+ * entry being read in or filled by a whole-sector write (LOADING) is
+ * waited for; one being written back
+ * (WRITING) or copied by a caller (PIN_CNT) stays readable and
+ * writable but is not evicted. */
+struct cache_entry {
+	disk_sector_t sector;               /* Sector held. */
+	bool valid;                         /* Holds SECTOR. */
+	bool dirty;                         /* Modified since read or written. */
+	bool accessed;                      /* Used since the clock hand passed. */
+	bool loading;                       /* DATA is being read or filled. */
+	bool writing;                       /* DATA is being written to disk. */
+	int pin_cnt;                        /* Callers copying DATA. */
+	uint8_t data[DISK_SECTOR_SIZE];     /* Contents of SECTOR. */
+};
+
+size_t buffer_cache_size = 64;
+
+static struct cache_entry *cache;       /* PAGE_CACHE_SIZE entries. */
+static size_t clock_hand;               /* Next entry the clock looks at. */
+static struct lock cache_lock;          /* Guards CACHE and CLOCK_HAND. */
+static struct condition cache_cond;     /* Signaled when I/O finishes. */
+
+/* Pending read-ahead requests, a ring of READAHEAD_QUEUE sectors. */
+static disk_sector_t ra_queue[READAHEAD_QUEUE];
+static size_t ra_head, ra_cnt;
+static struct lock ra_lock;
+static struct condition ra_cond;        /* Signaled when a request comes. */
+
+static size_t hit_cnt;                  /* # of accesses found in cache. */
+static size_t miss_cnt;                 /* # of accesses that read disk. */
+static size_t readahead_cnt;            /* # of sectors read ahead. */
+static size_t writeback_cnt;            /* # of dirty sectors written. */
+
+tid_t buffer_cache_workerd;
+
+static void buffer_cache_kworkerd (void *aux);
+static void buffer_cache_readaheadd (void *aux);
+
+/* Initializes the buffer cache and starts its daemons. */
+void
+buffer_cache_init (void) {
+	if (buffer_cache_size == 0)
+		buffer_cache_size = 1;
+	cache = calloc (buffer_cache_size, sizeof *cache);
+	if (cache == NULL)
+		PANIC ("buffer cache allocation failed");
+	lock_init (&cache_lock);
+	cond_init (&cache_cond);
+	lock_init (&ra_lock);
+	cond_init (&ra_cond);
+
+	buffer_cache_workerd = thread_create ("bcache_flush", PRI_DEFAULT,
+			buffer_cache_kworkerd, NULL);
+	thread_create ("bcache_readahead", PRI_DEFAULT, buffer_cache_readaheadd,
+			NULL);
+}
+
+/* Writes ENTRY back if it is dirty and not already being written,
+ * dropping cache_lock during the write.  The caller holds cache_lock. */
+static void
+entry_flush (struct cache_entry *entry) {
+	if (entry->valid && entry->dirty && !entry->loading && !entry->writing) {
+		entry->writing = true;
+		entry->dirty = false;
+		lock_release (&cache_lock);
+		disk_write (filesys_disk, entry->sector, entry->data);
+		lock_acquire (&cache_lock);
+		entry->writing = false;
+		writeback_cnt++;
+		cond_broadcast (&cache_cond, &cache_lock);
+	}
+}
+
+/* Returns the entry holding SECTOR, or NULL.  The caller holds
+ * cache_lock. */
+static struct cache_entry *
+entry_lookup (disk_sector_t sector) {
+	size_t i;
+
+	for (i = 0; i < buffer_cache_size; i++)
+		if (cache[i].valid && cache[i].sector == sector)
+			return &cache[i];
+	return NULL;
+}
+
+/* Returns a clean entry that no one is using, picked by the clock
+ * algorithm.  Dirty entries on the way are written back, and if
+ * everything is busy the caller waits for some I/O to finish, so
+ * cache_lock may be dropped meanwhile.  The caller holds cache_lock. */
+static struct cache_entry *
+entry_evict (void) {
+	size_t scanned = 0;
+
+	for (;;) {
+		struct cache_entry *entry = &cache[clock_hand];
+		clock_hand = (clock_hand + 1) % buffer_cache_size;
+
+		if (!entry->valid)
+			return entry;
+		if (entry->loading || entry->writing || entry->pin_cnt > 0) {
+			if (++scanned >= 2 * buffer_cache_size) {
+				cond_wait (&cache_cond, &cache_lock);
+				scanned = 0;
+			}
+		} else if (entry->accessed)
+			entry->accessed = false;
+		else if (entry->dirty)
+			entry_flush (entry);
+		else {
+			entry->valid = false;
+			return entry;
+		}
+	}
+}
+
+/* Returns the entry holding SECTOR, reading the sector in on a miss
+ * unless the caller will overwrite all of it (FULL_WRITE).  In that
+ * case the entry is returned still LOADING, so that no one reads the
+ * old contents, and the caller clears it once DATA is filled.  Returns
+ * with cache_lock held, which the caller holds on entry too, but may
+ * drop it meanwhile. */
+static struct cache_entry *
+entry_get (disk_sector_t sector, bool full_write) {
+	struct cache_entry *entry;
+
+	for (;;) {
+		entry = entry_lookup (sector);
+		if (entry != NULL) {
+			if (entry->loading) {
+				cond_wait (&cache_cond, &cache_lock);
+				continue;
+			}
+			hit_cnt++;
+			break;
+		}
+
+		/* Eviction may drop the lock, and another thread may bring
+		 * SECTOR in meanwhile. */
+		entry = entry_evict ();
+		if (entry_lookup (sector) != NULL)
+			continue;
+
+		miss_cnt++;
+		entry->sector = sector;
+		entry->valid = true;
+		entry->dirty = false;
+		entry->loading = true;
+		if (!full_write) {
+			lock_release (&cache_lock);
+			disk_read (filesys_disk, sector, entry->data);
+			lock_acquire (&cache_lock);
+			entry->loading = false;
+			cond_broadcast (&cache_cond, &cache_lock);
+		}
+		break;
+	}
+	entry->accessed = true;
+	return entry;
+}
+
+/* Reads SIZE bytes at offset OFS of SECTOR into BUFFER.  The copy runs
+ * without cache_lock, so BUFFER may be user memory that faults. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer, int ofs, int size) {
+	struct cache_entry *entry;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&cache_lock);
+	entry = entry_get (sector, false);
+	entry->pin_cnt++;
+	lock_release (&cache_lock);
+
+	memcpy (buffer, entry->data + ofs, size);
+
+	lock_acquire (&cache_lock);
+	entry->pin_cnt--;
+	cond_broadcast (&cache_cond, &cache_lock);
+	lock_release (&cache_lock);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS of SECTOR.  The sector
+ * reaches the disk later, by write-behind.  The entry is marked dirty
+ * once the copy is done, so a write-back that overlaps the copy is
+ * followed by another.  A whole-sector write that missed keeps the
+ * entry LOADING until then. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer, int ofs,
+		int size) {
+	struct cache_entry *entry;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&cache_lock);
+	entry = entry_get (sector, ofs == 0 && size == DISK_SECTOR_SIZE);
+	entry->pin_cnt++;
+	lock_release (&cache_lock);
+
+	memcpy (entry->data + ofs, buffer, size);
+
+	lock_acquire (&cache_lock);
+	entry->dirty = true;
+	entry->loading = false;
+	entry->pin_cnt--;
+	cond_broadcast (&cache_cond, &cache_lock);
+	lock_release (&cache_lock);
+}
+
+/* Asks for SECTOR to be read into the cache in the background.  Never
+ * blocks on I/O; the request is dropped if the queue is full. */
+void
+buffer_cache_readahead (disk_sector_t sector) {
+	lock_acquire (&ra_lock);
+	if (ra_cnt < READAHEAD_QUEUE) {
+		ra_queue[(ra_head + ra_cnt++) % READAHEAD_QUEUE] = sector;
+		cond_signal (&ra_cond, &ra_lock);
+	}
+	lock_release (&ra_lock);
+}
+
+/* Writes every dirty sector back to disk, waiting for write-backs
+ * already under way. */
+void
+buffer_cache_flush (void) {
+	size_t i;
+
+	lock_acquire (&cache_lock);
+	for (i = 0; i < buffer_cache_size; i++) {
+		while (cache[i].writing)
+			cond_wait (&cache_cond, &cache_lock);
+		entry_flush (&cache[i]);
+	}
+	lock_release (&cache_lock);
+}
+
+/* Prints buffer cache statistics. */
+void
+buffer_cache_print_stats (void) {
+	printf ("Buffer cache: %zu hits, %zu misses, %zu read ahead, "
+			"%zu written back\n", hit_cnt, miss_cnt, readahead_cnt,
+			writeback_cnt);
+}
+
+/* Worker thread for the buffer cache: writes the free map and dirty
+ * sectors behind. */
+static void
+buffer_cache_kworkerd (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (WRITE_BEHIND_TICKS);
+		filesys_sync ();
+	}
+}
+
+/* Worker thread for the buffer cache: serves read-ahead requests. */
+static void
+buffer_cache_readaheadd (void *aux UNUSED) {
+	for (;;) {
+		disk_sector_t sector;
+
+		lock_acquire (&ra_lock);
+		while (ra_cnt == 0)
+			cond_wait (&ra_cond, &ra_lock);
+		sector = ra_queue[ra_head];
+		ra_head = (ra_head + 1) % READAHEAD_QUEUE;
+		ra_cnt--;
+		lock_release (&ra_lock);
+
+		lock_acquire (&cache_lock);
+		if (entry_lookup (sector) == NULL) {
+			size_t misses = miss_cnt;
+			struct cache_entry *entry = entry_get (sector, false);
+			if (miss_cnt != misses) {
+				entry->accessed = false;
+				miss_cnt--;
+				readahead_cnt++;
+			} else
+				hit_cnt--;
+		}
+		lock_release (&cache_lock);
+	}
+}
@@ -1,10 +1,12 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir {
@@ -19,11 +21,195 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
+/* A small directory is a plain array of entries, searched linearly.
+ * Once a full one holds DIR_HASH_MIN entries it is rebuilt as a hash
+ * table: a header in the first slot, pointing to a power of 2 number of
+ * slots further on, each entry living at the slot its name hashes to or
+ * at one of the following ones (linear probing).  A removed entry keeps
+ * its name as a tombstone so that probes go on past it; a probe stops at
+ * a slot that was never used, whose name is empty.  A rebuilt table is
+ * written where it does not overlap the old one, and takes over when
+ * the header is rewritten: right after the header if it fits before the
+ * old table, or else right after the old table.  Tables therefore
+ * alternate between the two places, and the file stays within the
+ * header, two tables and the array it started as. */
+#define DIR_HASH_MIN 32
+#define DIR_HASH_MAGIC 0x48524944
+
+/* First slot of a hashed directory.  IN_USE is false, so the header
+ * reads as a free entry to code that scans entries. */
+struct dir_header {
+	uint32_t magic;                     /* DIR_HASH_MAGIC. */
+	uint32_t slot_cnt;                  /* Hash slots, a power of 2. */
+	uint32_t fill_cnt;                  /* Slots used, tombstones too. */
+	uint32_t base;                      /* Entry index of slot 0. */
+	char unused[NAME_MAX + 1 - 3 * sizeof (uint32_t)];
+	bool in_use;                        /* Always false. */
+};
+
+/* Cached result of a lookup, keyed by directory and name.  A negative
+ * entry records that the directory has no such name. */
+struct name_cache_entry {
+	disk_sector_t dir_sector;           /* Inode sector of the directory. */
+	char name[NAME_MAX + 1];            /* Name looked up. */
+	disk_sector_t inode_sector;         /* Entry found, or NAME_NEGATIVE. */
+	off_t ofs;                          /* Byte offset of the entry. */
+	struct hash_elem hash_elem;         /* Element of name_cache. */
+	struct list_elem lru_elem;          /* Element of name_lru. */
+};
+
+/* Entries the name cache holds before it drops the least recently
+ * used one. */
+#define NAME_CACHE_MAX 256
+
+/* inode_sector of a negative name cache entry. */
+#define NAME_NEGATIVE ((disk_sector_t) -1)
+
+static struct hash name_cache;
+static struct list name_lru;            /* Most recently used first. */
+static size_t name_cache_cnt;
+static struct lock name_cache_lock;     /* Guards the name cache. */
+
+static uint64_t
+name_cache_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct name_cache_entry *n =
+		hash_entry (e, struct name_cache_entry, hash_elem);
+	return hash_string (n->name) ^ hash_int (n->dir_sector);
+}
+
+static bool
+name_cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct name_cache_entry *a =
+		hash_entry (a_, struct name_cache_entry, hash_elem);
+	const struct name_cache_entry *b =
+		hash_entry (b_, struct name_cache_entry, hash_elem);
+	if (a->dir_sector != b->dir_sector)
+		return a->dir_sector < b->dir_sector;
+	return strcmp (a->name, b->name) < 0;
+}
+
+/* Initializes the directory module. */
+void
+dir_init (void) {
+	hash_init (&name_cache, name_cache_hash, name_cache_less, NULL);
+	list_init (&name_lru);
+	lock_init (&name_cache_lock);
+}
+
+/* Returns the cached entry for NAME in the directory at DIR_SECTOR, or
+ * NULL.  The caller holds name_cache_lock. */
+static struct name_cache_entry *
+name_cache_find (disk_sector_t dir_sector, const char *name) {
+	struct name_cache_entry key;
+	struct hash_elem *e;
+
+	if (strlen (name) > NAME_MAX)
+		return NULL;
+	key.dir_sector = dir_sector;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&name_cache, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct name_cache_entry, hash_elem) : NULL;
+}
+
+/* Drops N from the name cache.  The caller holds name_cache_lock. */
+static void
+name_cache_drop (struct name_cache_entry *n) {
+	hash_delete (&name_cache, &n->hash_elem);
+	list_remove (&n->lru_elem);
+	name_cache_cnt--;
+	free (n);
+}
+
+/* Remembers that NAME in the directory at DIR_SECTOR is the entry at
+ * byte offset OFS, for the inode at INODE_SECTOR, or that there is no
+ * such entry if INODE_SECTOR is NAME_NEGATIVE. */
+static void
+name_cache_insert (disk_sector_t dir_sector, const char *name,
+		disk_sector_t inode_sector, off_t ofs) {
+	struct name_cache_entry *n;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+	lock_acquire (&name_cache_lock);
+	n = name_cache_find (dir_sector, name);
+	if (n == NULL) {
+		if (name_cache_cnt == NAME_CACHE_MAX)
+			name_cache_drop (list_entry (list_back (&name_lru),
+						struct name_cache_entry, lru_elem));
+		n = malloc (sizeof *n);
+		if (n == NULL) {
+			lock_release (&name_cache_lock);
+			return;
+		}
+		n->dir_sector = dir_sector;
+		strlcpy (n->name, name, sizeof n->name);
+		hash_insert (&name_cache, &n->hash_elem);
+		name_cache_cnt++;
+	} else
+		list_remove (&n->lru_elem);
+	n->inode_sector = inode_sector;
+	n->ofs = ofs;
+	list_push_front (&name_lru, &n->lru_elem);
+	lock_release (&name_cache_lock);
+}
+
+/* Copies the cached entry for NAME in the directory at DIR_SECTOR into
+ * *COPY and returns true, or returns false if there is none. */
+static bool
+name_cache_get (disk_sector_t dir_sector, const char *name,
+		struct name_cache_entry *copy) {
+	struct name_cache_entry *n;
+
+	lock_acquire (&name_cache_lock);
+	n = name_cache_find (dir_sector, name);
+	if (n != NULL) {
+		list_remove (&n->lru_elem);
+		list_push_front (&name_lru, &n->lru_elem);
+		*copy = *n;
+	}
+	lock_release (&name_cache_lock);
+	return n != NULL;
+}
+
+/* Forgets every name of the directory at DIR_SECTOR. */
+static void
+name_cache_purge (disk_sector_t dir_sector) {
+	struct list_elem *e;
+
+	lock_acquire (&name_cache_lock);
+	e = list_begin (&name_lru);
+	while (e != list_end (&name_lru)) {
+		struct name_cache_entry *n =
+			list_entry (e, struct name_cache_entry, lru_elem);
+		e = list_next (e);
+		if (n->dir_sector == dir_sector)
+			name_cache_drop (n);
+	}
+	lock_release (&name_cache_lock);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
- * given SECTOR.  Returns true if successful, false on failure. */
+ * given SECTOR, whose "." names itself and ".." names the directory
+ * at PARENT_SECTOR.  Returns true if successful, false on failure. */
 bool
-dir_create (disk_sector_t sector, size_t entry_cnt) {
-	return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+dir_create (disk_sector_t sector, size_t entry_cnt,
+		disk_sector_t parent_sector) {
+	struct dir *dir;
+	bool success;
+
+	ASSERT (sizeof (struct dir_header) == sizeof (struct dir_entry));
+	if (!inode_create (sector, (entry_cnt + 2) * sizeof (struct dir_entry),
+				INODE_DIR))
+		return false;
+
+	name_cache_purge (sector);
+	dir = dir_open (inode_open (sector));
+	success = (dir != NULL
+			&& dir_add (dir, ".", sector)
+			&& dir_add (dir, "..", parent_sector));
+	dir_close (dir);
+	return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -71,30 +257,180 @@ dir_get_inode (struct dir *dir) {
 	return dir->inode;
 }
 
+/* Sets the position of the next dir_readdir () of DIR to POS, a value
+ * returned by dir_tell (). */
+void
+dir_seek (struct dir *dir, off_t pos) {
+	dir->pos = pos;
+}
+
+/* Returns the position of the next dir_readdir () of DIR. */
+off_t
+dir_tell (const struct dir *dir) {
+	return dir->pos;
+}
+
+/* Reads the header of DIR into *H and returns true if DIR is hashed. */
+static bool
+dir_read_header (const struct dir *dir, struct dir_header *h) {
+	return inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+		&& !h->in_use && h->magic == DIR_HASH_MAGIC;
+}
+
+/* Returns the byte offset of hash slot SLOT of a hashed directory with
+ * header H. */
+static off_t
+slot_ofs (const struct dir_header *h, uint32_t slot) {
+	return (h->base + slot) * sizeof (struct dir_entry);
+}
+
+/* Sets *START and *END to the byte range of DIR that holds its entries:
+ * the slots of a hashed directory, or all of a small one. */
+static void
+dir_entry_range (const struct dir *dir, off_t *start, off_t *end) {
+	struct dir_header h;
+
+	if (dir_read_header (dir, &h)) {
+		*start = slot_ofs (&h, 0);
+		*end = slot_ofs (&h, h.slot_cnt);
+	} else {
+		*start = 0;
+		*end = inode_length (dir->inode);
+	}
+}
+
 /* Searches DIR for a file with the given NAME.
  * If successful, returns true, sets *EP to the directory entry
  * if EP is non-null, and sets *OFSP to the byte offset of the
  * directory entry if OFSP is non-null.
- * otherwise, returns false and ignores EP and OFSP. */
+ * otherwise, returns false and ignores EP and OFSP.
+ * Answers from the name cache when it can; otherwise probes the hash
+ * table of a hashed directory, or scans a small one, and caches what
+ * it found, or that it found nothing.  A removed directory holds
+ * nothing. */
 static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
+	disk_sector_t dir_sector;
+	struct name_cache_entry n;
+	struct dir_header h;
 	struct dir_entry e;
 	size_t ofs;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (e.in_use && !strcmp (name, e.name)) {
-			if (ep != NULL)
-				*ep = e;
-			if (ofsp != NULL)
-				*ofsp = ofs;
-			return true;
+	if (inode_is_removed (dir->inode))
+		return false;
+
+	dir_sector = inode_get_inumber (dir->inode);
+	if (name_cache_get (dir_sector, name, &n)) {
+		if (n.inode_sector == NAME_NEGATIVE)
+			return false;
+		e.inode_sector = n.inode_sector;
+		strlcpy (e.name, n.name, sizeof e.name);
+		e.in_use = true;
+		ofs = n.ofs;
+		goto found;
+	}
+
+	if (dir_read_header (dir, &h)) {
+		uint32_t slot = hash_string (name) & (h.slot_cnt - 1);
+		uint32_t i;
+
+		for (i = 0; i < h.slot_cnt; i++, slot = (slot + 1) & (h.slot_cnt - 1)) {
+			ofs = slot_ofs (&h, slot);
+			if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e
+					|| e.name[0] == '\0')
+				break;
+			if (e.in_use && !strcmp (name, e.name))
+				goto found;
 		}
+	} else {
+		for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+				ofs += sizeof e)
+			if (e.in_use && !strcmp (name, e.name))
+				goto found;
+	}
+	name_cache_insert (dir_sector, name, NAME_NEGATIVE, 0);
 	return false;
+
+found:
+	name_cache_insert (dir_sector, e.name, e.inode_sector, ofs);
+	if (ep != NULL)
+		*ep = e;
+	if (ofsp != NULL)
+		*ofsp = ofs;
+	return true;
+}
+
+/* Returns the offset of the slot NAME goes to in the hashed directory
+ * DIR with header H: the first free slot of its probe sequence. */
+static off_t
+hash_slot_for (struct dir *dir, const struct dir_header *h,
+		const char *name) {
+	uint32_t slot = hash_string (name) & (h->slot_cnt - 1);
+	struct dir_entry e;
+
+	for (;;) {
+		off_t ofs = slot_ofs (h, slot);
+		if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e
+				|| !e.in_use)
+			return ofs;
+		slot = (slot + 1) & (h->slot_cnt - 1);
+	}
+}
+
+/* Rebuilds DIR as a hash table with room for its live entries and one
+ * more at a load of 1/4, dropping tombstones and moving the entries to
+ * their slots.  The new slots do not overlap the old entries and take
+ * effect only when the header is written, so on failure DIR keeps its
+ * old entries.  Returns true if successful. */
+static bool
+dir_rehash (struct dir *dir) {
+	static const struct dir_entry empty;
+	struct dir_header h;
+	struct dir_entry e, *live;
+	size_t live_cnt = 0, i;
+	off_t ofs, start, end;
+	bool success = false;
+
+	dir_entry_range (dir, &start, &end);
+	live = malloc (end - start);
+	if (live == NULL)
+		return false;
+	for (ofs = start; ofs < end
+			&& inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+			ofs += sizeof e)
+		if (e.in_use)
+			live[live_cnt++] = e;
+
+	memset (&h, 0, sizeof h);
+	h.magic = DIR_HASH_MAGIC;
+	h.slot_cnt = 1;
+	while (h.slot_cnt < 4 * (live_cnt + 1))
+		h.slot_cnt *= 2;
+	h.fill_cnt = live_cnt;
+	if (start >= (off_t) ((1 + h.slot_cnt) * sizeof e))
+		h.base = 1;
+	else
+		h.base = end / sizeof e;
+
+	for (i = 0; i < h.slot_cnt; i++)
+		if (inode_write_at (dir->inode, &empty, sizeof empty, slot_ofs (&h, i))
+				!= sizeof empty)
+			goto done;
+	for (i = 0; i < live_cnt; i++)
+		if (inode_write_at (dir->inode, &live[i], sizeof live[i],
+					hash_slot_for (dir, &h, live[i].name)) != sizeof live[i])
+			goto done;
+	success = inode_write_at (dir->inode, &h, sizeof h, 0) == sizeof h;
+	if (success)
+		name_cache_purge (inode_get_inumber (dir->inode));
+
+done:
+	free (live);
+	return success;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -109,10 +445,12 @@ dir_lookup (const struct dir *dir, const char *name,
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	rwlock_acquire_read (inode_dir_lock (dir->inode));
 	if (lookup (dir, name, &e, NULL))
 		*inode = inode_open (e.inode_sector);
 	else
 		*inode = NULL;
+	rwlock_release_read (inode_dir_lock (dir->inode));
 
 	return *inode != NULL;
 }
@@ -125,6 +463,7 @@ dir_lookup (const struct dir *dir, const char *name,
  * error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+	struct dir_header h;
 	struct dir_entry e;
 	off_t ofs;
 	bool success = false;
@@ -136,10 +475,32 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	if (*name == '\0' || strlen (name) > NAME_MAX)
 		return false;
 
+	/* Nothing may be added to a removed directory. */
+	rwlock_acquire_write (inode_dir_lock (dir->inode));
+	if (inode_is_removed (dir->inode))
+		goto done;
+
 	/* Check that NAME is not in use. */
 	if (lookup (dir, name, NULL, NULL))
 		goto done;
 
+	/* In a hashed directory, take the slot NAME hashes to, rebuilding
+	 * the table first if that would fill more than half of it. */
+	if (dir_read_header (dir, &h)) {
+		if (2 * (h.fill_cnt + 1) > h.slot_cnt) {
+			if (!dir_rehash (dir))
+				goto done;
+			dir_read_header (dir, &h);
+		}
+		ofs = hash_slot_for (dir, &h, name);
+		if (inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e
+				&& e.name[0] == '\0')
+			h.fill_cnt++;
+		if (inode_write_at (dir->inode, &h, sizeof h, 0) != sizeof h)
+			goto done;
+		goto write;
+	}
+
 	/* Set OFS to offset of free slot.
 	 * If there are no free slots, then it will be set to the
 	 * current end-of-file.
@@ -152,23 +513,58 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 		if (!e.in_use)
 			break;
 
+	/* A full directory that has grown large is turned into a hash
+	 * table instead of being extended. */
+	if (ofs / (off_t) sizeof e >= DIR_HASH_MIN) {
+		if (!dir_rehash (dir))
+			goto done;
+		dir_read_header (dir, &h);
+		ofs = hash_slot_for (dir, &h, name);
+		h.fill_cnt++;
+		if (inode_write_at (dir->inode, &h, sizeof h, 0) != sizeof h)
+			goto done;
+	}
+
+write:
 	/* Write slot. */
 	e.in_use = true;
 	strlcpy (e.name, name, sizeof e.name);
 	e.inode_sector = inode_sector;
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+	if (success)
+		name_cache_insert (inode_get_inumber (dir->inode), name, inode_sector,
+				ofs);
 
 done:
+	rwlock_release_write (inode_dir_lock (dir->inode));
 	return success;
 }
 
+/* Returns true if "." and ".." are the only entries of DIR. */
+static bool
+dir_is_empty (struct dir *dir) {
+	struct dir_entry e;
+	off_t ofs, start, end;
+
+	dir_entry_range (dir, &start, &end);
+	for (ofs = start; ofs < end
+			&& inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+			ofs += sizeof e)
+		if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
+			return false;
+	return true;
+}
+
 /* Removes any entry for NAME in DIR.
  * Returns true if successful, false on failure,
- * which occurs only if there is no file with the given NAME. */
+ * which occurs if there is no file with the given NAME, if NAME is
+ * "." or "..", or if it is the root or a directory that is not
+ * empty. */
 bool
 dir_remove (struct dir *dir, const char *name) {
 	struct dir_entry e;
 	struct inode *inode = NULL;
+	struct rwlock *victim_lock = NULL;
 	bool success = false;
 	off_t ofs;
 
@@ -176,7 +572,9 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (name != NULL);
 
 	/* Find directory entry. */
-	if (!lookup (dir, name, &e, &ofs))
+	rwlock_acquire_write (inode_dir_lock (dir->inode));
+	if (!strcmp (name, ".") || !strcmp (name, "..")
+			|| !lookup (dir, name, &e, &ofs))
 		goto done;
 
 	/* Open inode. */
@@ -184,33 +582,65 @@ dir_remove (struct dir *dir, const char *name) {
 	if (inode == NULL)
 		goto done;
 
-	/* Erase directory entry. */
+	/* Only an empty directory other than the root may go.  Its own
+	 * entry lock is held until it is marked removed, so that nothing
+	 * is added to it meanwhile. */
+	if (inode_get_type (inode) == INODE_DIR) {
+		struct dir victim = { inode, 0 };
+
+		if (e.inode_sector == ROOT_DIR_SECTOR)
+			goto done;
+		victim_lock = inode_dir_lock (inode);
+		rwlock_acquire_write (victim_lock);
+		if (!dir_is_empty (&victim))
+			goto done;
+	}
+
+	/* Erase directory entry, leaving its name as a tombstone. */
 	e.in_use = false;
 	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
 		goto done;
+	name_cache_insert (inode_get_inumber (dir->inode), name, NAME_NEGATIVE, 0);
 
-	/* Remove inode. */
+	/* Remove inode, and what is cached about its own entries. */
+	if (inode_get_type (inode) == INODE_DIR)
+		name_cache_purge (e.inode_sector);
 	inode_remove (inode);
 	success = true;
 
 done:
+	if (victim_lock != NULL)
+		rwlock_release_write (victim_lock);
 	inode_close (inode);
+	rwlock_release_write (inode_dir_lock (dir->inode));
 	return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
  * NAME.  Returns true if successful, false if the directory
- * contains no more entries. */
+ * contains no more entries.  "." and ".." are skipped. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
-
-	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
+	off_t start, end;
+	bool found = false;
+
+	rwlock_acquire_read (inode_dir_lock (dir->inode));
+	dir_entry_range (dir, &start, &end);
+	if (dir->pos < start)
+		dir->pos = start;
+	while (dir->pos < end
+			&& inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
 		dir->pos += sizeof e;
-		if (e.in_use) {
-			strlcpy (name, e.name, NAME_MAX + 1);
-			return true;
+		if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, "..")) {
+			found = true;
+			break;
 		}
 	}
-	return false;
+	rwlock_release_read (inode_dir_lock (dir->inode));
+
+	/* NAME may be user memory, so it is written without the lock. */
+	if (found)
+		strlcpy (name, e.name, NAME_MAX + 1);
+	return found;
 }
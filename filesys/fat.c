@@ -1,4 +1,5 @@
 #include "filesys/fat.h"
+#include <bitmap.h>
 #include "devices/disk.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
@@ -24,12 +25,15 @@ struct fat_fs {
 	disk_sector_t data_start;
 	cluster_t last_clst;
 	struct lock write_lock;
+	struct bitmap *free_map;    /* Clusters in use, built at mount. */
+	struct bitmap *dirty;       /* FAT sectors changed since written. */
 };
 
 static struct fat_fs *fat_fs;
 
 void fat_boot_create (void);
 void fat_fs_init (void);
+static void fat_build_free_map (void);
 
 void
 fat_init (void) {
@@ -53,6 +57,7 @@ fat_init (void) {
 
 void
 fat_open (void) {
+	free (fat_fs->fat);
 	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT load failed");
@@ -78,6 +83,7 @@ fat_open (void) {
 			free (bounce);
 		}
 	}
+	fat_build_free_map ();
 }
 
 void
@@ -90,27 +96,43 @@ fat_close (void) {
 	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
 	free (bounce);
 
-	// Write FAT directly to the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_wrote = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT close failed");
-			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
-			free (bounce);
+	fat_flush ();
+}
+
+/* Writes the FAT sectors changed since they were last written.  Each
+ * one is copied out under the write lock, so allocation goes on while
+ * it is being written. */
+void
+fat_flush (void) {
+	size_t fat_bytes;
+	uint8_t *bounce;
+	unsigned i;
+
+	if (fat_fs == NULL || fat_fs->fat == NULL)
+		return;
+	fat_bytes = fat_fs->fat_length * sizeof (cluster_t);
+	bounce = malloc (DISK_SECTOR_SIZE);
+	if (bounce == NULL)
+		PANIC ("FAT flush failed");
+	for (i = 0; i < fat_fs->bs.fat_sectors; i++) {
+		size_t ofs = (size_t) i * DISK_SECTOR_SIZE, size = 0;
+
+		lock_acquire (&fat_fs->write_lock);
+		if (!bitmap_test (fat_fs->dirty, i)) {
+			lock_release (&fat_fs->write_lock);
+			continue;
 		}
+		bitmap_reset (fat_fs->dirty, i);
+		if (ofs < fat_bytes)
+			size = fat_bytes - ofs < DISK_SECTOR_SIZE
+				? fat_bytes - ofs : DISK_SECTOR_SIZE;
+		memcpy (bounce, (uint8_t *) fat_fs->fat + ofs, size);
+		memset (bounce + size, 0, DISK_SECTOR_SIZE - size);
+		lock_release (&fat_fs->write_lock);
+
+		disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
 	}
+	free (bounce);
 }
 
 void
@@ -120,12 +142,18 @@ fat_create (void) {
 	fat_fs_init ();
 
 	// Create FAT table
+	free (fat_fs->fat);
 	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT creation failed");
+	fat_build_free_map ();
+
+	// Every sector of a new FAT must reach the disk
+	bitmap_set_all (fat_fs->dirty, true);
 
 	// Set up ROOT_DIR_CLST
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
+	bitmap_mark (fat_fs->free_map, ROOT_DIR_CLUSTER);
 
 	// Fill up ROOT_DIR_CLUSTER region with 0
 	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
@@ -152,7 +180,34 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	/* Cluster 0 is never used, so that a 0 in the FAT means free. */
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+		/ SECTORS_PER_CLUSTER + 1;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER;
+	lock_init (&fat_fs->write_lock);
+
+	/* Formatting runs this a second time, after fat_init (). */
+	bitmap_destroy (fat_fs->dirty);
+	fat_fs->dirty = bitmap_create (fat_fs->bs.fat_sectors);
+	if (fat_fs->dirty == NULL)
+		PANIC ("FAT init failed");
+}
+
+/* Rebuild the map of clusters in use from the FAT, so that allocation
+ * does not scan the FAT. */
+static void
+fat_build_free_map (void) {
+	cluster_t clst;
+
+	bitmap_destroy (fat_fs->free_map);
+	fat_fs->free_map = bitmap_create (fat_fs->fat_length);
+	if (fat_fs->free_map == NULL)
+		PANIC ("FAT free map creation failed");
+	bitmap_mark (fat_fs->free_map, 0);
+	for (clst = 1; clst < fat_fs->fat_length; clst++)
+		if (fat_fs->fat[clst] != 0)
+			bitmap_mark (fat_fs->free_map, clst);
 }
 
 /*----------------------------------------------------------------------------*/
@@ -161,33 +216,73 @@ fat_fs_init (void) {
 
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
- * Returns 0 if fails to allocate a new cluster. */
+ * Returns 0 if fails to allocate a new cluster.
+ * The search for a free cluster starts right after CLST, so that a
+ * growing file stays close together, or after the last one allocated
+ * for a new chain. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	size_t new;
+
+	lock_acquire (&fat_fs->write_lock);
+	new = bitmap_scan_and_flip (fat_fs->free_map,
+			clst != 0 ? clst : fat_fs->last_clst, 1, false);
+	if (new == BITMAP_ERROR)
+		new = bitmap_scan_and_flip (fat_fs->free_map, 1, 1, false);
+	if (new == BITMAP_ERROR) {
+		lock_release (&fat_fs->write_lock);
+		return 0;
+	}
+
+	fat_put (new, EOChain);
+	if (clst != 0)
+		fat_put (clst, new);
+	fat_fs->last_clst = new;
+	lock_release (&fat_fs->write_lock);
+	return new;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	if (pclst != 0)
+		fat_put (pclst, EOChain);
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next = fat_get (clst);
+		fat_put (clst, 0);
+		bitmap_reset (fat_fs->free_map, clst);
+		clst = next;
+	}
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst != 0 && clst < fat_fs->fat_length);
+	fat_fs->fat[clst] = val;
+	bitmap_mark (fat_fs->dirty, clst * sizeof (cluster_t) / DISK_SECTOR_SIZE);
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst != 0 && clst < fat_fs->fat_length);
+	return fat_fs->fat[clst];
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst != 0 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
+}
+
+/* Covert a sector number to the cluster # holding it. */
+cluster_t
+sector_to_cluster (disk_sector_t sector) {
+	ASSERT (sector >= fat_fs->data_start);
+	return (sector - fat_fs->data_start) / SECTORS_PER_CLUSTER + 1;
 }
@@ -6,12 +6,14 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/buffer_cache.h"
 #include "devices/disk.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 
 /* The disk that contains the file system. */
 struct disk *filesys_disk;
-struct lock filesys_lock;
 
 static void do_format (void);
 
@@ -24,7 +26,8 @@ filesys_init (bool format) {
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
 	inode_init ();
-	lock_init(&filesys_lock);
+	dir_init ();
+	buffer_cache_init ();
 
 #ifdef EFILESYS
 	fat_init ();
@@ -54,6 +57,209 @@ filesys_done (void) {
 #else
 	free_map_close ();
 #endif
+	buffer_cache_flush ();
+}
+
+/* Writes the free map and every dirty cached sector to disk. */
+void
+filesys_sync (void) {
+	free_map_flush ();
+	buffer_cache_flush ();
+}
+
+/* Symbolic links that resolving one path may follow, so that a cycle
+ * of links fails instead of looping. */
+#define SYMLINK_MAX 8
+
+/* Longest target a symbolic link may hold. */
+#define SYMLINK_LEN_MAX (DISK_SECTOR_SIZE - 1)
+
+static struct inode *lookup_at (struct dir *dir, const char *name,
+		bool follow, int *links);
+
+/* Extracts a file name part from *SRCP into PART, and updates *SRCP so
+ * that the next call will return the next file name part.  Returns 1
+ * if successful, 0 at end of string, -1 for a too-long file name
+ * part. */
+static int
+next_part (char part[NAME_MAX + 1], const char **srcp) {
+	const char *src = *srcp;
+	char *dst = part;
+
+	/* Skip leading slashes.  If it's all slashes, we're done. */
+	while (*src == '/')
+		src++;
+	if (*src == '\0')
+		return 0;
+
+	/* Copy up to NAME_MAX character from SRC to DST.  Add null
+	 * terminator. */
+	while (*src != '/' && *src != '\0') {
+		if (dst < part + NAME_MAX)
+			*dst++ = *src;
+		else
+			return -1;
+		src++;
+	}
+	*dst = '\0';
+
+	/* Advance source pointer. */
+	*srcp = src;
+	return 1;
+}
+
+/* Resolves every component of PATH but the last, starting from the
+ * directory CWD, or the root if CWD is null, if PATH is relative.  On
+ * success, copies the last component to NAME and returns the directory
+ * that holds it, open, which the caller must close; the last component
+ * of the root is ".".  Returns a null pointer on failure.  Each
+ * directory on the way is kept open while the next is looked up in
+ * it, so none of them can be removed and its sector reused under the
+ * walk.  Symbolic links on the way are followed, counting against
+ * *LINKS. */
+static struct dir *
+resolve_parent (struct dir *cwd, const char *path,
+		char name[NAME_MAX + 1], int *links) {
+	char next[NAME_MAX + 1];
+	struct dir *dir;
+	int r;
+
+	if (*path == '\0')
+		return NULL;
+	dir = *path == '/' || cwd == NULL ? dir_open_root () : dir_reopen (cwd);
+
+	r = next_part (name, &path);
+	if (r == 0)
+		strlcpy (name, ".", NAME_MAX + 1);
+	while (dir != NULL && r > 0 && (r = next_part (next, &path)) > 0) {
+		struct inode *inode = lookup_at (dir, name, true, links);
+
+		dir_close (dir);
+		if (inode != NULL && inode_get_type (inode) != INODE_DIR) {
+			inode_close (inode);
+			inode = NULL;
+		}
+		dir = dir_open (inode);
+		strlcpy (name, next, NAME_MAX + 1);
+	}
+	if (r < 0) {
+		dir_close (dir);
+		return NULL;
+	}
+	return dir;
+}
+
+/* Resolves PATH from the directory CWD, or the root if CWD is null,
+ * following a symbolic link in the last component only if FOLLOW is
+ * true.  Returns the inode found, open, or a null pointer. */
+static struct inode *
+resolve (struct dir *cwd, const char *path, bool follow, int *links) {
+	char name[NAME_MAX + 1];
+	struct inode *inode;
+	struct dir *dir;
+
+	dir = resolve_parent (cwd, path, name, links);
+	if (dir == NULL)
+		return NULL;
+	inode = lookup_at (dir, name, follow, links);
+	dir_close (dir);
+	return inode;
+}
+
+/* Returns the target of the symbolic link INODE in a string that the
+ * caller must free, or a null pointer. */
+static char *
+read_link (struct inode *inode) {
+	char *target = NULL;
+	off_t length;
+
+	length = inode_length (inode);
+	if (length <= SYMLINK_LEN_MAX && (target = malloc (length + 1)) != NULL) {
+		if (inode_read_at (inode, target, length, 0) == length)
+			target[length] = '\0';
+		else {
+			free (target);
+			target = NULL;
+		}
+	}
+	return target;
+}
+
+/* Looks up NAME in the directory DIR, which the caller keeps open, and
+ * returns its inode, open, or a null pointer.  The inode is opened
+ * under the directory's lock, so the entry cannot be removed and its
+ * sector reused in between.  A symbolic link found is followed if
+ * FOLLOW is true, its target being resolved relative to DIR; more than
+ * SYMLINK_MAX links in all fail the lookup. */
+static struct inode *
+lookup_at (struct dir *dir, const char *name, bool follow, int *links) {
+	struct inode *inode, *found;
+	char *target;
+
+	if (!dir_lookup (dir, name, &inode))
+		return NULL;
+	if (inode_get_type (inode) != INODE_SYMLINK || !follow)
+		return inode;
+
+	target = ++*links <= SYMLINK_MAX ? read_link (inode) : NULL;
+	inode_close (inode);
+	if (target == NULL)
+		return NULL;
+	found = resolve (dir, target, true, links);
+	free (target);
+	return found;
+}
+
+/* Creates an inode of the given TYPE under PATH: a file of
+ * INITIAL_SIZE bytes, an empty directory, or a symbolic link to
+ * TARGET.  Returns true if successful, false otherwise. */
+static bool
+create_at (const char *path, off_t initial_size, enum inode_type type,
+		const char *target) {
+	disk_sector_t inode_sector = 0, parent;
+	char name[NAME_MAX + 1];
+	struct dir *dir = NULL;
+	struct inode *inode;
+	bool created = false;
+	int links = 0;
+
+	dir = resolve_parent (thread_current ()->cwd, path, name, &links);
+	if (dir == NULL)
+		goto done;
+	parent = inode_get_inumber (dir_get_inode (dir));
+	if (!free_map_allocate_near (parent, 1, &inode_sector))
+		goto done;
+
+	if (type == INODE_DIR)
+		created = dir_create (inode_sector, 16, parent);
+	else
+		created = inode_create (inode_sector, initial_size, type);
+	if (created && type == INODE_SYMLINK) {
+		off_t length = strlen (target);
+		inode = inode_open (inode_sector);
+		if (inode == NULL
+				|| inode_write_at (inode, target, length, 0) != length) {
+			inode_close (inode);
+			goto done;
+		}
+		inode_close (inode);
+	}
+	if (created && dir_add (dir, name, inode_sector)) {
+		dir_close (dir);
+		return true;
+	}
+
+done:
+	if (created) {
+		/* Closing the removed inode frees its sector and data. */
+		inode = inode_open (inode_sector);
+		if (inode != NULL)
+			inode_remove (inode);
+		inode_close (inode);
+	} else if (inode_sector != 0)
+		free_map_release (inode_sector, 1);
+	dir_close (dir);
+	return false;
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -62,44 +268,71 @@ filesys_done (void) {
  * or if internal memory allocation fails. */
 bool
 filesys_create (const char *name, off_t initial_size) {
-	disk_sector_t inode_sector = 0;
-	struct dir *dir = dir_open_root ();
-	bool success = (dir != NULL
-			&& free_map_allocate (1, &inode_sector)
-			&& inode_create (inode_sector, initial_size)
-			&& dir_add (dir, name, inode_sector));
-	if (!success && inode_sector != 0)
-		free_map_release (inode_sector, 1);
-	dir_close (dir);
+	return create_at (name, initial_size, INODE_FILE, NULL);
+}
 
-	return success;
+/* Creates an empty directory named NAME.
+ * Returns true if successful, false otherwise. */
+bool
+filesys_mkdir (const char *name) {
+	return create_at (name, 0, INODE_DIR, NULL);
+}
+
+/* Creates a symbolic link LINKPATH that refers to TARGET, which need
+ * not exist.  Returns true if successful, false otherwise. */
+bool
+filesys_symlink (const char *target, const char *linkpath) {
+	if (*target == '\0' || strlen (target) > SYMLINK_LEN_MAX)
+		return false;
+	return create_at (linkpath, 0, INODE_SYMLINK, target);
 }
 
-/* Opens the file with the given NAME.
+/* Opens the file or directory with the given NAME.
  * Returns the new file if successful or a null pointer
  * otherwise.
  * Fails if no file named NAME exists,
  * or if an internal memory allocation fails. */
 struct file *
 filesys_open (const char *name) {
-	struct dir *dir = dir_open_root ();
-	struct inode *inode = NULL;
+	int links = 0;
 
-	if (dir != NULL)
-		dir_lookup (dir, name, &inode);
-	dir_close (dir);
+	return file_open (resolve (thread_current ()->cwd, name, true, &links));
+}
+
+/* Makes the directory NAME the working directory of the current
+ * thread.  Returns true if successful, false otherwise. */
+bool
+filesys_chdir (const char *name) {
+	struct thread *curr = thread_current ();
+	struct inode *inode;
+	struct dir *dir;
+	int links = 0;
 
-	return file_open (inode);
+	inode = resolve (curr->cwd, name, true, &links);
+	if (inode != NULL && inode_get_type (inode) != INODE_DIR) {
+		inode_close (inode);
+		return false;
+	}
+	if ((dir = dir_open (inode)) == NULL)
+		return false;
+	dir_close (curr->cwd);
+	curr->cwd = dir;
+	return true;
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file, empty directory or symbolic link named NAME.
  * Returns true if successful, false on failure.
  * Fails if no file named NAME exists,
  * or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) {
-	struct dir *dir = dir_open_root ();
-	bool success = dir != NULL && dir_remove (dir, name);
+	char last[NAME_MAX + 1];
+	struct dir *dir;
+	bool success;
+	int links = 0;
+
+	dir = resolve_parent (thread_current ()->cwd, name, last, &links);
+	success = dir != NULL && dir_remove (dir, last);
 	dir_close (dir);
 
 	return success;
@@ -113,10 +346,12 @@ do_format (void) {
 #ifdef EFILESYS
 	/* Create FAT and save it to the disk. */
 	fat_create ();
+	if (!dir_create (ROOT_DIR_SECTOR, 16, ROOT_DIR_SECTOR))
+		PANIC ("root directory creation failed");
 	fat_close ();
 #else
 	free_map_create ();
-	if (!dir_create (ROOT_DIR_SECTOR, 16))
+	if (!dir_create (ROOT_DIR_SECTOR, 16, ROOT_DIR_SECTOR))
 		PANIC ("root directory creation failed");
 	free_map_close ();
 #endif
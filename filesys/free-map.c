@@ -1,47 +1,156 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
 
+#ifdef EFILESYS
+/* On a FAT file system the FAT itself keeps track of free space.  Each
+ * sector allocated here, an inode, is one cluster in a chain of its
+ * own. */
+
+/* Allocates CNT consecutive sectors and stores the first into
+ * *SECTORP.  Only single sectors are supported, and the FAT picks them
+ * by itself, so HINT is ignored.
+ * Returns true if successful. */
+bool
+free_map_allocate_near (disk_sector_t hint UNUSED, size_t cnt,
+		disk_sector_t *sectorp) {
+	cluster_t clst;
+
+	if (cnt != 1 || (clst = fat_create_chain (0)) == 0)
+		return false;
+	*sectorp = cluster_to_sector (clst);
+	return true;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use. */
+void
+free_map_release (disk_sector_t sector, size_t cnt) {
+	ASSERT (cnt == 1);
+	fat_remove_chain (sector_to_cluster (sector), 0);
+}
+
+/* Writes the FAT sectors changed since the last flush. */
+void
+free_map_flush (void) {
+	fat_flush ();
+}
+#else
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static struct bitmap *free_map_dirty; /* File sectors not yet written. */
+static struct lock free_map_lock;    /* Guards the above and the file. */
+
+/* Free map bits held by one sector of the free map file. */
+#define BITS_PER_SECTOR (DISK_SECTOR_SIZE * 8)
+
+/* Records that the CNT bits starting at SECTOR changed, so that the
+ * free map file sectors holding them are written by the next flush.
+ * The caller holds free_map_lock. */
+static void
+mark_dirty (disk_sector_t sector, size_t cnt) {
+	size_t first = sector / BITS_PER_SECTOR;
+	size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+	bitmap_set_multiple (free_map_dirty, first, last - first + 1, true);
+}
 
 /* Initializes the free map. */
 void
 free_map_init (void) {
+	lock_init (&free_map_lock);
 	free_map = bitmap_create (disk_size (filesys_disk));
 	if (free_map == NULL)
 		PANIC ("bitmap creation failed--disk is too large");
+	free_map_dirty = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+				DISK_SECTOR_SIZE));
+	if (free_map_dirty == NULL)
+		PANIC ("bitmap creation failed--disk is too large");
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
- * the first into *SECTORP.
+/* Allocates CNT consecutive sectors from the free map, preferring the
+ * first free run at or after HINT, such as the sector of the inode
+ * they will belong to, and stores the first into *SECTORP.  The free
+ * map reaches the disk later, by free_map_flush ().
  * Returns true if successful, false if all sectors were
  * available. */
 bool
-free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR
-			&& free_map_file != NULL
-			&& !bitmap_write (free_map, free_map_file)) {
-		bitmap_set_multiple (free_map, sector, cnt, false);
-		sector = BITMAP_ERROR;
-	}
+free_map_allocate_near (disk_sector_t hint, size_t cnt,
+		disk_sector_t *sectorp) {
+	disk_sector_t sector;
+
+	lock_acquire (&free_map_lock);
+	if (hint >= bitmap_size (free_map))
+		hint = 0;
+	sector = bitmap_scan_and_flip (free_map, hint, cnt, false);
+	if (sector == BITMAP_ERROR && hint != 0)
+		sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+	if (sector != BITMAP_ERROR)
+		mark_dirty (sector, cnt);
+	lock_release (&free_map_lock);
 	if (sector != BITMAP_ERROR)
 		*sectorp = sector;
 	return sector != BITMAP_ERROR;
 }
 
+/* Allocates up to CNT sectors starting exactly at SECTOR, stopping at
+ * the first one already in use, so that a file can grow in place.
+ * Returns the number of sectors allocated. */
+size_t
+free_map_extend (disk_sector_t sector, size_t cnt) {
+	size_t got = 0;
+
+	lock_acquire (&free_map_lock);
+	while (got < cnt && sector + got < bitmap_size (free_map)
+			&& !bitmap_test (free_map, sector + got))
+		got++;
+	if (got > 0) {
+		bitmap_set_multiple (free_map, sector, got, true);
+		mark_dirty (sector, got);
+	}
+	lock_release (&free_map_lock);
+	return got;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
+	lock_acquire (&free_map_lock);
 	ASSERT (bitmap_all (free_map, sector, cnt));
 	bitmap_set_multiple (free_map, sector, cnt, false);
-	bitmap_write (free_map, free_map_file);
+	mark_dirty (sector, cnt);
+	lock_release (&free_map_lock);
+}
+
+/* Writes the sectors of the free map file changed since the last
+ * flush, one write per run of consecutive dirty sectors.  Sectors
+ * that fail to write stay dirty. */
+void
+free_map_flush (void) {
+	size_t cnt, i = 0, run;
+
+	/* The write-behind thread may run before free_map_init (). */
+	if (free_map_dirty == NULL)
+		return;
+	lock_acquire (&free_map_lock);
+	cnt = bitmap_size (free_map_dirty);
+	while (free_map_file != NULL
+			&& (i = bitmap_scan (free_map_dirty, i, 1, true)) != BITMAP_ERROR) {
+		for (run = 1; i + run < cnt && bitmap_test (free_map_dirty, i + run);
+				run++)
+			continue;
+		if (bitmap_write_range (free_map, free_map_file,
+					i * DISK_SECTOR_SIZE, run * DISK_SECTOR_SIZE))
+			bitmap_set_multiple (free_map_dirty, i, run, false);
+		i += run;
+	}
+	lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -57,7 +166,11 @@ free_map_open (void) {
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) {
+	free_map_flush ();
+	lock_acquire (&free_map_lock);
 	file_close (free_map_file);
+	free_map_file = NULL;
+	lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -65,7 +178,8 @@ free_map_close (void) {
 void
 free_map_create (void) {
 	/* Create inode. */
-	if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+	if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map),
+				INODE_FILE))
 		PANIC ("free map creation failed");
 
 	/* Write bitmap to file. */
@@ -74,4 +188,14 @@ free_map_create (void) {
 		PANIC ("can't open free map");
 	if (!bitmap_write (free_map, free_map_file))
 		PANIC ("can't write free map");
+	bitmap_set_all (free_map_dirty, false);
+}
+#endif
+
+/* Allocates CNT consecutive sectors anywhere on the disk and stores
+ * the first into *SECTORP.
+ * Returns true if successful. */
+bool
+free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
+	return free_map_allocate_near (0, cnt, sectorp);
 }
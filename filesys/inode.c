@@ -1,23 +1,76 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+#ifdef EFILESYS
+/* A FAT file system keeps its free space in the FAT, one entry per
+ * cluster, and that is the only allocation state on its disk.  File
+ * data is therefore the FAT chain itself rather than the extents of the
+ * other build, which would need a free map of their own next to the
+ * FAT.  fat_create_chain () places each new cluster right after the
+ * previous one when it can, so chains stay as contiguous as extents
+ * would, and the skip index below bounds the cost of a seek. */
+
+/* Clusters of a file whose written state the inode tracks. */
+#define WRITTEN_BITS (124 * 32)
+
+/* On-disk inode.
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ * The data sectors are the clusters of the FAT chain from START.
+ * Cluster IDX of the chain has been written if bit IDX of WRITTEN is
+ * set; the others read as zeros, so that growing a file needs no disk
+ * writes.  Clusters past the first WRITTEN_BITS have no bit and are
+ * zeroed as soon as they are allocated. */
+struct inode_disk {
+	cluster_t start;                    /* First data cluster, 0 if none. */
+	off_t length;                       /* File size in bytes. */
+	unsigned magic;                     /* Magic number. */
+	uint32_t type;                      /* enum inode_type. */
+	uint32_t written[WRITTEN_BITS / 32];    /* Bit per cluster written. */
+};
+#else
+/* A run of COUNT consecutive data sectors starting at START.  The
+ * sectors of an UNWRITTEN run are allocated but have never been
+ * written, so they read as zeros whatever the disk holds. */
+struct extent {
+	disk_sector_t start;                /* First sector of the run. */
+	uint32_t count : 31;                /* Number of sectors. */
+	uint32_t unwritten : 1;             /* Sectors read as zeros. */
+};
+
+/* Extents kept in the inode itself and in its overflow block. */
+#define INODE_EXTENTS 61
+#define OVERFLOW_EXTENTS (DISK_SECTOR_SIZE / sizeof (struct extent))
+#define MAX_EXTENTS (INODE_EXTENTS + OVERFLOW_EXTENTS)
+
 /* On-disk inode.
- * Must be exactly DISK_SECTOR_SIZE bytes long. */
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ * The data sectors are described by EXTENT_CNT extents in file order,
+ * the first INODE_EXTENTS of them here and the rest in the OVERFLOW
+ * sector.  Together they hold at least bytes_to_sectors (LENGTH)
+ * sectors; more only after a failed attempt to grow. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t extent_cnt;                /* Number of extents in use. */
+	disk_sector_t overflow;             /* Sector of more extents, or 0. */
+	uint32_t type;                      /* enum inode_type. */
+	uint32_t unused;                    /* Not used. */
+	struct extent extents[INODE_EXTENTS];   /* Data sectors. */
 };
+#endif
 
 /* Returns the number of sectors to allocate for an inode SIZE
  * bytes long. */
@@ -26,72 +79,557 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+ * OPEN_CNT is guarded by open_inodes_lock and the rest by LOCK, which
+ * is also held while the inode is read in by its first opener.  Reads
+ * and writes inside the file hold DATA_LOCK shared and writes that
+ * extend the file hold it exclusive, so that readers never see the
+ * new length before the data.  DIR_LOCK guards the entries of a
+ * directory; see directory.c. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in open_inodes. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
+	struct rwlock data_lock;            /* Guards the file contents. */
+	struct rwlock dir_lock;             /* Guards directory entries. */
+	struct lock lock;                   /* Guards the fields below. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
 	struct inode_disk data;             /* Inode content. */
+#ifdef EFILESYS
+	cluster_t last_clst;                /* Last cluster of the chain, or 0. */
+	size_t clst_cnt;                    /* Clusters in the chain. */
+	bool chain_known;                   /* LAST_CLST and CLST_CNT are valid. */
+	cluster_t cur_clst;                 /* Cluster last looked up, or 0. */
+	size_t cur_idx;                     /* Its index in the chain. */
+	cluster_t *skip;                    /* Every SKIP_STRIDE'th cluster. */
+	size_t skip_cnt, skip_cap;          /* Entries used and allocated. */
+#else
+	struct extent *overflow;            /* Contents of data.overflow, or NULL. */
+	uint32_t first[MAX_EXTENTS];        /* File sector each extent starts at. */
+#endif
 };
 
+#ifdef EFILESYS
+/* Clusters between two entries of the skip index of an inode. */
+#define SKIP_STRIDE 16
+
+/* Chain lookups, for inode_print_stats (). */
+static size_t chain_lookups;            /* # of inode_chain_at () calls. */
+static size_t chain_steps;              /* # of FAT entries they followed. */
+static size_t chain_steps_from_start;   /* # a walk from START would take. */
+
+/* Records CLST, cluster number IDX of the chain of INODE, in the skip
+ * index if it is the next entry due.  Without memory the index just
+ * stops growing. */
+static void
+inode_skip_note (struct inode *inode, size_t idx, cluster_t clst) {
+	if (idx % SKIP_STRIDE != 0 || idx / SKIP_STRIDE != inode->skip_cnt)
+		return;
+	if (inode->skip_cnt == inode->skip_cap) {
+		size_t cap = inode->skip_cap ? inode->skip_cap * 2 : 8;
+		cluster_t *skip = realloc (inode->skip, cap * sizeof *skip);
+		if (skip == NULL)
+			return;
+		inode->skip = skip;
+		inode->skip_cap = cap;
+	}
+	inode->skip[inode->skip_cnt++] = clst;
+}
+
+/* Returns cluster number IDX of the chain of INODE, which must be that
+ * long.  The walk starts from the cursor, when it is at or before IDX,
+ * or else from the nearest skip index entry, so sequential access costs
+ * one step per cluster and a seek at most SKIP_STRIDE steps once the
+ * index is built.  Entries passed on the way are added to the index. */
+static cluster_t
+inode_chain_at (struct inode *inode, size_t idx) {
+	size_t i = 0;
+	cluster_t clst = inode->data.start;
+
+	inode_skip_note (inode, 0, clst);
+	if (inode->skip_cnt > 0) {
+		size_t k = idx / SKIP_STRIDE;
+		if (k >= inode->skip_cnt)
+			k = inode->skip_cnt - 1;
+		i = k * SKIP_STRIDE;
+		clst = inode->skip[k];
+	}
+	if (inode->cur_clst != 0 && i < inode->cur_idx && inode->cur_idx <= idx) {
+		i = inode->cur_idx;
+		clst = inode->cur_clst;
+	}
+	chain_lookups++;
+	chain_steps += idx - i;
+	chain_steps_from_start += idx;
+	while (i < idx) {
+		clst = fat_get (clst);
+		inode_skip_note (inode, ++i, clst);
+	}
+
+	inode->cur_clst = clst;
+	inode->cur_idx = idx;
+	return clst;
+}
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
  * POS. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos) {
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
+	if (pos >= inode->data.length)
+		return -1;
+	return cluster_to_sector (inode_chain_at (inode, pos / DISK_SECTOR_SIZE));
+}
+
+/* Writes the on-disk part of INODE back. */
+static void
+inode_write_disk (struct inode *inode) {
+	buffer_cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+}
+
+/* Walks the chain of INODE once to find its last cluster, which later
+ * appends then extend directly.  The walk resumes from the end of the
+ * skip index. */
+static void
+inode_find_tail (struct inode *inode) {
+	cluster_t clst = inode->data.start;
+	size_t idx = 0;
+
+	inode->last_clst = 0;
+	inode->clst_cnt = 0;
+	if (clst != 0) {
+		inode_skip_note (inode, 0, clst);
+		if (inode->skip_cnt > 0) {
+			idx = (inode->skip_cnt - 1) * SKIP_STRIDE;
+			clst = inode->skip[inode->skip_cnt - 1];
+		}
+		for (;;) {
+			cluster_t next = fat_get (clst);
+			if (next == EOChain)
+				break;
+			clst = next;
+			inode_skip_note (inode, ++idx, clst);
+		}
+		inode->last_clst = clst;
+		inode->clst_cnt = idx + 1;
+	}
+	inode->chain_known = true;
+}
+
+/* Grows INODE to LENGTH bytes, appending clusters to its chain.  Their
+ * bits are clear, so they read as zeros without being written, except
+ * those past WRITTEN_BITS, which are zeroed in the buffer cache.  On
+ * failure the file keeps whatever clusters it got, but its length is
+ * unchanged.  Returns true if successful. */
+static bool
+inode_grow (struct inode *inode, off_t length) {
+	static const char zeros[DISK_SECTOR_SIZE];
+	size_t need = bytes_to_sectors (length);
+
+	if (!inode->chain_known)
+		inode_find_tail (inode);
+	while (inode->clst_cnt < need) {
+		cluster_t clst = fat_create_chain (inode->last_clst);
+		if (clst == 0) {
+			inode_write_disk (inode);
+			return false;
+		}
+		if (inode->last_clst == 0)
+			inode->data.start = clst;
+		inode_skip_note (inode, inode->clst_cnt, clst);
+		if (inode->clst_cnt >= WRITTEN_BITS)
+			buffer_cache_write (cluster_to_sector (clst), zeros, 0,
+					DISK_SECTOR_SIZE);
+		inode->last_clst = clst;
+		inode->clst_cnt++;
+	}
+	if (length > inode->data.length)
+		inode->data.length = length;
+	inode_write_disk (inode);
+	return true;
+}
+
+/* Returns true if data sector IDX of INODE has never been written. */
+static bool
+inode_is_unwritten (struct inode *inode, size_t idx) {
+	return idx < WRITTEN_BITS
+		&& (inode->data.written[idx / 32] & (1u << idx % 32)) == 0;
+}
+
+/* Zeros data sector IDX of INODE, which is unwritten, and marks it
+ * written, so that it may be written in part.  Other unwritten
+ * sectors stay as they are.  The zeros go to the buffer cache only. */
+static void
+inode_mark_written (struct inode *inode, size_t idx) {
+	static const char zeros[DISK_SECTOR_SIZE];
+
+	ASSERT (inode_is_unwritten (inode, idx));
+	buffer_cache_write (cluster_to_sector (inode_chain_at (inode, idx)),
+			zeros, 0, DISK_SECTOR_SIZE);
+	inode->data.written[idx / 32] |= 1u << idx % 32;
+	inode_write_disk (inode);
+}
+
+/* Releases the data clusters of INODE. */
+static void
+inode_free_blocks (struct inode *inode) {
+	if (inode->data.start != 0)
+		fat_remove_chain (inode->data.start, 0);
+}
+
+/* Reads the on-disk inode at INODE->sector into INODE. */
+static void
+inode_read_disk (struct inode *inode) {
+	buffer_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	inode->chain_known = false;
+	inode->cur_clst = 0;
+	inode->skip = NULL;
+	inode->skip_cnt = inode->skip_cap = 0;
+}
+
+/* Frees INODE and the memory it holds. */
+static void
+inode_free (struct inode *inode) {
+	free (inode->skip);
+	free (inode);
+}
+#else
+
+/* Returns extent IDX of INODE. */
+static struct extent *
+inode_extent (struct inode *inode, size_t idx) {
+	ASSERT (idx < MAX_EXTENTS);
+	if (idx < INODE_EXTENTS)
+		return &inode->data.extents[idx];
+	return &inode->overflow[idx - INODE_EXTENTS];
+}
+
+/* Returns the index of the extent of INODE that holds data sector
+ * IDX, which must exist.  Binary searches the extents. */
+static size_t
+inode_extent_at (struct inode *inode, size_t idx) {
+	size_t lo = 0, hi = inode->data.extent_cnt;
+
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (inode->first[mid] <= idx)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Returns the disk sector that contains byte offset POS within
+ * INODE.
+ * Returns -1 if INODE does not contain data for a byte at offset
+ * POS. */
+static disk_sector_t
+byte_to_sector (struct inode *inode, off_t pos) {
+	ASSERT (inode != NULL);
+	if (pos >= inode->data.length)
 		return -1;
+
+	uint32_t idx = pos / DISK_SECTOR_SIZE;
+	size_t i = inode_extent_at (inode, idx);
+	return inode_extent (inode, i)->start + (idx - inode->first[i]);
+}
+
+/* Recomputes the file sector each extent of INODE starts at, from
+ * extent FROM on. */
+static void
+inode_index_extents (struct inode *inode, size_t from) {
+	size_t i;
+
+	for (i = from; i < inode->data.extent_cnt; i++)
+		inode->first[i] = i > 0
+			? inode->first[i - 1] + inode_extent (inode, i - 1)->count : 0;
+}
+
+/* Writes the on-disk part of INODE back. */
+static void
+inode_write_disk (struct inode *inode) {
+	buffer_cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	if (inode->overflow != NULL)
+		buffer_cache_write (inode->data.overflow, inode->overflow, 0,
+				DISK_SECTOR_SIZE);
+}
+
+/* Makes room for CNT extents in INODE, allocating its overflow block
+ * if they do not fit in the inode.  Returns false if INODE cannot
+ * hold that many. */
+static bool
+inode_reserve_extents (struct inode *inode, size_t cnt) {
+	if (cnt > MAX_EXTENTS)
+		return false;
+	if (cnt > INODE_EXTENTS && inode->overflow == NULL) {
+		inode->overflow = calloc (1, DISK_SECTOR_SIZE);
+		if (inode->overflow == NULL)
+			return false;
+		if (!free_map_allocate_near (inode->sector, 1,
+					&inode->data.overflow)) {
+			free (inode->overflow);
+			inode->overflow = NULL;
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Appends the CNT unwritten sectors at START to the extents of INODE,
+ * merging them into the last extent when it is unwritten too and they
+ * follow it on disk.  Returns false if INODE has no room for another
+ * extent. */
+static bool
+inode_add_run (struct inode *inode, disk_sector_t start, size_t cnt) {
+	size_t n = inode->data.extent_cnt;
+
+	if (n > 0) {
+		struct extent *last = inode_extent (inode, n - 1);
+		if (last->unwritten && last->start + last->count == start) {
+			last->count += cnt;
+			return true;
+		}
+	}
+	if (!inode_reserve_extents (inode, n + 1))
+		return false;
+
+	inode_extent (inode, n)->start = start;
+	inode_extent (inode, n)->count = cnt;
+	inode_extent (inode, n)->unwritten = true;
+	inode->data.extent_cnt++;
+	inode_index_extents (inode, n);
+	return true;
+}
+
+/* Replaces extents LO to HI - 1 of INODE by the CNT extents in NEW,
+ * which cover the same file sectors.  Returns false, leaving INODE
+ * untouched, if it has no room for them. */
+static bool
+inode_splice (struct inode *inode, size_t lo, size_t hi,
+		const struct extent *new, size_t cnt) {
+	size_t n = inode->data.extent_cnt, old = hi - lo, i;
+
+	if (!inode_reserve_extents (inode, n - old + cnt))
+		return false;
+	if (cnt > old)
+		for (i = n; i-- > hi; )
+			*inode_extent (inode, i + cnt - old) = *inode_extent (inode, i);
+	else if (cnt < old)
+		for (i = hi; i < n; i++)
+			*inode_extent (inode, i - old + cnt) = *inode_extent (inode, i);
+	for (i = 0; i < cnt; i++)
+		*inode_extent (inode, lo + i) = new[i];
+	inode->data.extent_cnt = n - old + cnt;
+	inode_index_extents (inode, lo);
+	return true;
+}
+
+/* Allocates up to CNT unwritten sectors for INODE, preferring the ones
+ * right after its last extent so that the file stays sequential, and
+ * otherwise the longest free run found by halving CNT, searched from
+ * the end of the file or from its inode.  Nothing is written to them.
+ * Returns the number of sectors added, 0 if the disk or the extents
+ * are full. */
+static size_t
+inode_alloc_run (struct inode *inode, size_t cnt) {
+	disk_sector_t start, hint = inode->sector;
+	size_t n = inode->data.extent_cnt, got = 0;
+
+	if (n > 0) {
+		struct extent *last = inode_extent (inode, n - 1);
+		start = hint = last->start + last->count;
+		got = free_map_extend (start, cnt);
+	}
+	while (got == 0 && cnt > 0) {
+		if (free_map_allocate_near (hint, cnt, &start))
+			got = cnt;
+		else
+			cnt /= 2;
+	}
+	if (got == 0)
+		return 0;
+
+	if (!inode_add_run (inode, start, got)) {
+		free_map_release (start, got);
+		return 0;
+	}
+	return got;
+}
+
+/* Grows INODE to LENGTH bytes, allocating the sectors it needs.  On
+ * failure the file keeps whatever sectors it got, but its length is
+ * unchanged.  Returns true if successful. */
+static bool
+inode_grow (struct inode *inode, off_t length) {
+	size_t have = bytes_to_sectors (inode->data.length);
+	size_t need = bytes_to_sectors (length);
+	size_t n = inode->data.extent_cnt;
+
+	if (n > 0)
+		have = inode->first[n - 1] + inode_extent (inode, n - 1)->count;
+	while (have < need) {
+		size_t got = inode_alloc_run (inode, need - have);
+		if (got == 0) {
+			inode_write_disk (inode);
+			return false;
+		}
+		have += got;
+	}
+	if (length > inode->data.length)
+		inode->data.length = length;
+	inode_write_disk (inode);
+	return true;
+}
+
+/* Returns true if data sector IDX of INODE has never been written. */
+static bool
+inode_is_unwritten (struct inode *inode, size_t idx) {
+	return inode_extent (inode, inode_extent_at (inode, idx))->unwritten;
+}
+
+/* Zeros data sector IDX of INODE, which is unwritten, and splits it out
+ * of its extent as a written one, merged with the written extents
+ * around it when they are adjacent on disk.  With no room for the
+ * split, the whole extent is zeroed instead.  The zeros go to the
+ * buffer cache only. */
+static void
+inode_mark_written (struct inode *inode, size_t idx) {
+	static char zeros[DISK_SECTOR_SIZE];
+	size_t n = inode->data.extent_cnt, i = inode_extent_at (inode, idx);
+	struct extent e = *inode_extent (inode, i), new[3], mid;
+	size_t ofs = idx - inode->first[i], lo = i, hi = i + 1, cnt = 0, k;
+
+	ASSERT (e.unwritten);
+	buffer_cache_write (e.start + ofs, zeros, 0, DISK_SECTOR_SIZE);
+
+	mid.start = e.start + ofs;
+	mid.count = 1;
+	mid.unwritten = false;
+	if (ofs > 0) {
+		new[cnt] = e;
+		new[cnt++].count = ofs;
+	} else if (i > 0) {
+		struct extent *prev = inode_extent (inode, i - 1);
+		if (!prev->unwritten && prev->start + prev->count == mid.start) {
+			mid.start = prev->start;
+			mid.count = prev->count + 1;
+			lo = i - 1;
+		}
+	}
+	if (ofs + 1 < e.count) {
+		new[cnt++] = mid;
+		new[cnt].start = e.start + ofs + 1;
+		new[cnt].count = e.count - ofs - 1;
+		new[cnt++].unwritten = true;
+	} else {
+		if (i + 1 < n) {
+			struct extent *next = inode_extent (inode, i + 1);
+			if (!next->unwritten && mid.start + mid.count == next->start) {
+				mid.count += next->count;
+				hi = i + 2;
+			}
+		}
+		new[cnt++] = mid;
+	}
+
+	if (!inode_splice (inode, lo, hi, new, cnt)) {
+		for (k = 0; k < e.count; k++)
+			if (k != ofs)
+				buffer_cache_write (e.start + k, zeros, 0, DISK_SECTOR_SIZE);
+		inode_extent (inode, i)->unwritten = false;
+	}
+	inode_write_disk (inode);
+}
+
+/* Releases the data sectors and the overflow block of INODE. */
+static void
+inode_free_blocks (struct inode *inode) {
+	size_t i;
+
+	for (i = 0; i < inode->data.extent_cnt; i++) {
+		struct extent *e = inode_extent (inode, i);
+		free_map_release (e->start, e->count);
+	}
+	if (inode->overflow != NULL)
+		free_map_release (inode->data.overflow, 1);
+}
+
+/* Reads the on-disk inode at INODE->sector into INODE. */
+static void
+inode_read_disk (struct inode *inode) {
+	buffer_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	inode->overflow = NULL;
+	if (inode->data.overflow != 0) {
+		inode->overflow = malloc (DISK_SECTOR_SIZE);
+		if (inode->overflow == NULL)
+			PANIC ("inode overflow extents allocation failed");
+		buffer_cache_read (inode->data.overflow, inode->overflow, 0,
+				DISK_SECTOR_SIZE);
+	}
+	inode_index_extents (inode, 0);
 }
 
-/* List of open inodes, so that opening a single inode twice
+/* Frees INODE and the memory it holds. */
+static void
+inode_free (struct inode *inode) {
+	free (inode->overflow);
+	free (inode);
+}
+#endif
+
+/* Open inodes hashed by sector, so that opening a single inode twice
  * returns the same `struct inode'. */
-static struct list open_inodes;
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+
+static uint64_t
+inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+		< hash_entry (b, struct inode, elem)->sector;
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	hash_init (&open_inodes, inode_hash, inode_less, NULL);
+	lock_init (&open_inodes_lock);
 }
 
-/* Initializes an inode with LENGTH bytes of data and
- * writes the new inode to sector SECTOR on the file system
+/* Initializes an inode of the given TYPE with LENGTH bytes of data
+ * and writes the new inode to sector SECTOR on the file system
  * disk.
  * Returns true if successful.
  * Returns false if memory or disk allocation fails. */
 bool
-inode_create (disk_sector_t sector, off_t length) {
-	struct inode_disk *disk_inode = NULL;
+inode_create (disk_sector_t sector, off_t length, enum inode_type type) {
+	struct inode *inode = NULL;
 	bool success = false;
 
 	ASSERT (length >= 0);
 
 	/* If this assertion fails, the inode structure is not exactly
 	 * one sector in size, and you should fix that. */
-	ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
-
-	disk_inode = calloc (1, sizeof *disk_inode);
-	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
-		disk_inode->length = length;
-		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
-		free (disk_inode);
+	ASSERT (sizeof inode->data == DISK_SECTOR_SIZE);
+
+	inode = calloc (1, sizeof *inode);
+	if (inode != NULL) {
+		inode->sector = sector;
+		inode->data.magic = INODE_MAGIC;
+		inode->data.type = type;
+		success = inode_grow (inode, length);
+		if (!success)
+			inode_free_blocks (inode);
+		inode_free (inode);
 	}
 	return success;
 }
@@ -101,39 +639,56 @@ inode_create (disk_sector_t sector, off_t length) {
  * Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
-	struct inode *inode;
-
-	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
-		}
+	struct inode key, *inode;
+	struct hash_elem *e;
+
+	/* Check whether this inode is already open.  If it is still being
+	 * read in, wait for that to finish. */
+	key.sector = sector;
+	lock_acquire (&open_inodes_lock);
+	e = hash_find (&open_inodes, &key.elem);
+	if (e != NULL) {
+		inode = hash_entry (e, struct inode, elem);
+		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+		lock_acquire (&inode->lock);
+		lock_release (&inode->lock);
+		return inode;
 	}
 
 	/* Allocate memory. */
 	inode = malloc (sizeof *inode);
-	if (inode == NULL)
+	if (inode == NULL) {
+		lock_release (&open_inodes_lock);
 		return NULL;
+	}
 
-	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
+	/* Initialize, then read the inode in without blocking opens and
+	 * closes of other inodes. */
 	inode->sector = sector;
 	inode->open_cnt = 1;
+	rwlock_init (&inode->data_lock);
+	rwlock_init (&inode->dir_lock);
+	lock_init (&inode->lock);
+	lock_acquire (&inode->lock);
+	hash_insert (&open_inodes, &inode->elem);
+	lock_release (&open_inodes_lock);
+
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	inode_read_disk (inode);
+	lock_release (&inode->lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&open_inodes_lock);
 		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+	}
 	return inode;
 }
 
@@ -143,6 +698,25 @@ inode_get_inumber (const struct inode *inode) {
 	return inode->sector;
 }
 
+/* Returns the lock that guards the entries of INODE, a directory. */
+struct rwlock *
+inode_dir_lock (struct inode *inode) {
+	return &inode->dir_lock;
+}
+
+/* Returns what INODE holds. */
+enum inode_type
+inode_get_type (const struct inode *inode) {
+	return inode->data.type;
+}
+
+/* Returns true if INODE has been removed and only awaits its last
+ * close. */
+bool
+inode_is_removed (const struct inode *inode) {
+	return inode->removed;
+}
+
 /* Closes INODE and writes it to disk.
  * If this was the last reference to INODE, frees its memory.
  * If INODE was also a removed inode, frees its blocks. */
@@ -153,19 +727,22 @@ inode_close (struct inode *inode) {
 		return;
 
 	/* Release resources if this was the last opener. */
+	lock_acquire (&open_inodes_lock);
 	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
+		/* Remove from the open inodes, after which no one else can
+		 * find INODE. */
+		hash_delete (&open_inodes, &inode->elem);
+		lock_release (&open_inodes_lock);
 
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
 			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+			inode_free_blocks (inode);
 		}
 
-		free (inode); 
-	}
+		inode_free (inode);
+	} else
+		lock_release (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -173,21 +750,59 @@ inode_close (struct inode *inode) {
 void
 inode_remove (struct inode *inode) {
 	ASSERT (inode != NULL);
+	lock_acquire (&inode->lock);
 	inode->removed = true;
+	lock_release (&inode->lock);
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+/* Returns the disk sector that holds byte offset POS of INODE, or -1.
+ * Sets *UNWRITTEN if the sector has never been written, so that it
+ * reads as zeros whatever the disk holds. */
+static disk_sector_t
+inode_sector_at (struct inode *inode, off_t pos, bool *unwritten) {
+	disk_sector_t sector;
+
+	lock_acquire (&inode->lock);
+	sector = byte_to_sector (inode, pos);
+	*unwritten = sector != (disk_sector_t) -1
+		&& inode_is_unwritten (inode, pos / DISK_SECTOR_SIZE);
+	lock_release (&inode->lock);
+	return sector;
+}
+
+/* Returns the disk sector that holds byte offset POS of INODE, or -1,
+ * zeroing it first if it has never been written so that a partial
+ * write leaves zeros around the new bytes. */
+static disk_sector_t
+inode_sector_for_write (struct inode *inode, off_t pos) {
+	disk_sector_t sector;
+
+	lock_acquire (&inode->lock);
+	sector = byte_to_sector (inode, pos);
+	if (sector != (disk_sector_t) -1
+			&& inode_is_unwritten (inode, pos / DISK_SECTOR_SIZE))
+		inode_mark_written (inode, pos / DISK_SECTOR_SIZE);
+	lock_release (&inode->lock);
+	return sector;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, kernel memory, starting at
+ * position OFFSET.
  * Returns the number of bytes actually read, which may be less
- * than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
+ * than SIZE if an error occurs or end of file is reached.
+ * Unwritten sectors read as zeros without touching the disk.
+ * The sector after the last one read is read ahead. */
+static off_t
+inode_read_kernel (struct inode *inode, void *buffer_, off_t size,
+		off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
 
+	rwlock_acquire_read (&inode->data_lock);
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		bool unwritten;
+		disk_sector_t sector_idx = inode_sector_at (inode, offset, &unwritten);
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -200,49 +815,61 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		if (unwritten)
+			memset (buffer + bytes_read, 0, chunk_size);
+		else
+			buffer_cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+					chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
 
+	if (bytes_read > 0) {
+		off_t next = ROUND_UP (offset, DISK_SECTOR_SIZE);
+		bool unwritten;
+		if (next < inode_length (inode)) {
+			disk_sector_t sector = inode_sector_at (inode, next, &unwritten);
+			if (!unwritten)
+				buffer_cache_readahead (sector);
+		}
+	}
+	rwlock_release_read (&inode->data_lock);
 	return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+/* Writes SIZE bytes from BUFFER, kernel memory, into INODE, starting
+ * at OFFSET.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+ * less than SIZE if the disk fills up or an error occurs.
+ * A write past end of file extends the inode first, holding the data
+ * lock exclusive until the new bytes are in place. */
+static off_t
+inode_write_kernel (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
+	bool extend = false;
 
-	if (inode->deny_write_cnt)
-		return 0;
+	rwlock_acquire_read (&inode->data_lock);
+	if (size > 0 && offset + size > inode_length (inode)) {
+		rwlock_release_read (&inode->data_lock);
+		rwlock_acquire_write (&inode->data_lock);
+		extend = true;
+	}
+
+	lock_acquire (&inode->lock);
+	if (inode->deny_write_cnt
+			|| (extend && offset + size > inode->data.length
+				&& !inode_grow (inode, offset + size)))
+		size = 0;
+	lock_release (&inode->lock);
 
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		disk_sector_t sector_idx = inode_sector_for_write (inode, offset);
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -255,35 +882,78 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		buffer_cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
 
+	if (extend)
+		rwlock_release_write (&inode->data_lock);
+	else
+		rwlock_release_read (&inode->data_lock);
+	return bytes_written;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+ * Returns the number of bytes actually read, which may be less
+ * than SIZE if an error occurs or end of file is reached.
+ * User memory is filled from a bounce buffer a sector at a time, so
+ * that a fault on it, which may write back a mapping of this very
+ * inode or kill the process, never happens while the data lock or a
+ * buffer cache entry is held. */
+off_t
+inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
+	uint8_t *buffer = buffer_;
+	uint8_t bounce[DISK_SECTOR_SIZE];
+	off_t bytes_read = 0;
+
+	if (!is_user_vaddr (buffer))
+		return inode_read_kernel (inode, buffer, size, offset);
+
+	while (size > 0) {
+		off_t chunk = size < DISK_SECTOR_SIZE ? size : DISK_SECTOR_SIZE;
+		off_t got = inode_read_kernel (inode, bounce, chunk, offset);
+
+		memcpy (buffer + bytes_read, bounce, got);
+		bytes_read += got;
+		if (got < chunk)
+			break;
+		size -= got;
+		offset += got;
+	}
+	return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+ * Returns the number of bytes actually written, which may be
+ * less than SIZE if the disk fills up or an error occurs.
+ * User memory goes through a bounce buffer, as in inode_read_at (). */
+off_t
+inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+		off_t offset) {
+	const uint8_t *buffer = buffer_;
+	uint8_t bounce[DISK_SECTOR_SIZE];
+	off_t bytes_written = 0;
+
+	if (!is_user_vaddr (buffer))
+		return inode_write_kernel (inode, buffer, size, offset);
+
+	while (size > 0) {
+		off_t chunk = size < DISK_SECTOR_SIZE ? size : DISK_SECTOR_SIZE;
+		off_t put;
+
+		memcpy (bounce, buffer + bytes_written, chunk);
+		put = inode_write_kernel (inode, bounce, chunk, offset);
+		bytes_written += put;
+		if (put < chunk)
+			break;
+		size -= put;
+		offset += put;
+	}
 	return bytes_written;
 }
 
@@ -292,8 +962,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	void
 inode_deny_write (struct inode *inode) 
 {
+	lock_acquire (&inode->lock);
 	inode->deny_write_cnt++;
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	lock_release (&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -301,9 +973,11 @@ inode_deny_write (struct inode *inode)
  * inode_deny_write() on the inode, before closing the inode. */
 void
 inode_allow_write (struct inode *inode) {
+	lock_acquire (&inode->lock);
 	ASSERT (inode->deny_write_cnt > 0);
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
 	inode->deny_write_cnt--;
+	lock_release (&inode->lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -311,3 +985,13 @@ off_t
 inode_length (const struct inode *inode) {
 	return inode->data.length;
 }
+
+/* Prints how far FAT chain lookups walked, next to how far walks from
+ * the start of each chain would have gone. */
+void
+inode_print_stats (void) {
+#ifdef EFILESYS
+	printf ("FAT chain: %zu lookups, %zu steps, %zu from the chain start\n",
+			chain_lookups, chain_steps, chain_steps_from_start);
+#endif
+}
@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/disk.h"
+#include "filesys/inode.h"
+#include "filesys/off_t.h"
 
 /* Maximum length of a file name component.
  * This is the traditional UNIX maximum length.
@@ -11,10 +13,11 @@
  * retained, but much longer full path names must be allowed. */
 #define NAME_MAX 14
 
-struct inode;
+void dir_init (void);
 
 /* Opening and closing directories. */
-bool dir_create (disk_sector_t sector, size_t entry_cnt);
+bool dir_create (disk_sector_t sector, size_t entry_cnt,
+		disk_sector_t parent_sector);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
 struct dir *dir_reopen (struct dir *);
@@ -26,5 +29,7 @@ bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, disk_sector_t);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+void dir_seek (struct dir *, off_t pos);
+off_t dir_tell (const struct dir *);
 
 #endif /* filesys/directory.h */
@@ -5,17 +5,27 @@
 #include "filesys/off_t.h"
 
 /* Sectors of system file inodes. */
+#ifdef EFILESYS
+#include "filesys/fat.h"
+/* The FAT replaces the free map; the root directory inode is the
+ * first data cluster. */
+#define ROOT_DIR_SECTOR (cluster_to_sector (ROOT_DIR_CLUSTER))
+#else
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#endif
 
 /* Disk used for file system. */
 extern struct disk *filesys_disk;
-extern struct lock filesys_lock;
 
 void filesys_init (bool format);
 void filesys_done (void);
+void filesys_sync (void);
 bool filesys_create (const char *name, off_t initial_size);
+bool filesys_mkdir (const char *name);
+bool filesys_symlink (const char *target, const char *linkpath);
 struct file *filesys_open (const char *name);
+bool filesys_chdir (const char *name);
 bool filesys_remove (const char *name);
 
 #endif /* filesys/filesys.h */
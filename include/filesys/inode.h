@@ -6,12 +6,23 @@
 #include "devices/disk.h"
 
 struct bitmap;
+struct rwlock;
+
+/* What an inode holds. */
+enum inode_type {
+	INODE_FILE,                         /* Ordinary file. */
+	INODE_DIR,                          /* Directory. */
+	INODE_SYMLINK                       /* Symbolic link; data is the target. */
+};
 
 void inode_init (void);
-bool inode_create (disk_sector_t, off_t);
+bool inode_create (disk_sector_t, off_t, enum inode_type);
 struct inode *inode_open (disk_sector_t);
 struct inode *inode_reopen (struct inode *);
 disk_sector_t inode_get_inumber (const struct inode *);
+enum inode_type inode_get_type (const struct inode *);
+bool inode_is_removed (const struct inode *);
+struct rwlock *inode_dir_lock (struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
@@ -19,5 +30,6 @@ off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+void inode_print_stats (void);
 
 #endif /* filesys/inode.h */
@@ -50,6 +50,18 @@ static __inline uint64_t rcr3(void) {
 	return val;
 }
 
+__attribute__((always_inline))
+static __inline void lcr4(uint64_t val) {
+	__asm __volatile("movq %0, %%cr4" : : "r" (val));
+}
+
+__attribute__((always_inline))
+static __inline uint64_t rcr4(void) {
+	uint64_t val;
+	__asm __volatile("movq %%cr4,%0" : "=r" (val));
+	return val;
+}
+
 __attribute__((always_inline))
 static __inline uint64_t rrax(void) {
 	uint64_t val;
@@ -0,0 +1,15 @@
+#ifndef __LIB_MADVISE_H
+#define __LIB_MADVISE_H
+
+/* Advice accepted by the madvise system call.  The first three set
+   how the kernel pages a mapped area from then on; the last two act
+   on the given range once. */
+enum {
+	MADV_NORMAL,                /* No special treatment. */
+	MADV_RANDOM,                /* No read ahead, no large pages. */
+	MADV_SEQUENTIAL,            /* Read ahead, evict pages left behind. */
+	MADV_WILLNEED,              /* Bring the range in now. */
+	MADV_DONTNEED,              /* Drop the range and its swap. */
+};
+
+#endif /* lib/madvise.h */
@@ -0,0 +1,12 @@
+#ifndef __LIB_MMAN_H
+#define __LIB_MMAN_H
+
+/* Flag for the FLAGS argument of mmap_anon.  It makes the anonymous
+   mapping shared with children forked later instead of copied into
+   them. */
+#define MAP_SHARED 0x2
+
+/* fd argument of mmap for private memory not backed by a file. */
+#define MAP_ANON_FD (-1)
+
+#endif /* lib/mman.h */
@@ -36,6 +36,13 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Extra for Project 3 */
+	SYS_VMSTAT,                 /* Report paging statistics. */
+	SYS_MADVISE,                /* Give paging advice for a range. */
+	SYS_MSYNC,                  /* Write back a file mapping. */
+	SYS_MEMPRESSURE,            /* Report the memory pressure level. */
+	SYS_MMAP_ANON,              /* Map memory not backed by a file. */
 };
 
 #endif /* lib/syscall-nr.h */
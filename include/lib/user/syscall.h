@@ -4,6 +4,9 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <vmstat.h>
+#include <madvise.h>
+#include <mman.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -40,7 +43,12 @@ int dup2(int oldfd, int newfd);
 
 /* Project 3 and optionally project 4. */
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
+void *mmap_anon (void *addr, size_t length, int writable, int flags);
 void munmap (void *addr);
+bool vmstat (struct vmstat *stat);
+int madvise (void *addr, size_t length, int advice);
+int msync (void *addr, size_t length);
+int mempressure (void);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
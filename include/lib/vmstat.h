@@ -0,0 +1,29 @@
+#ifndef __LIB_VMSTAT_H
+#define __LIB_VMSTAT_H
+
+#include <stdint.h>
+
+/* Paging statistics of one process, as returned by the vmstat
+   system call.  Every fault is either minor or major; stack and
+   COW faults are counted once more in their own field. */
+struct vmstat {
+	uint64_t minor_faults;      /* Faults resolved without I/O. */
+	uint64_t major_faults;      /* Faults that read swap or a file. */
+	uint64_t stack_faults;      /* Faults that grew the stack. */
+	uint64_t cow_faults;        /* Writes that copied a shared frame. */
+	uint64_t evictions;         /* Pages of this process evicted. */
+	uint64_t resident;          /* Pages in memory at the last sample. */
+	uint64_t working_set;       /* Pages accessed in the last interval. */
+};
+
+/* Memory pressure, as returned by the mempressure system call.
+   NONE while free frames are plentiful; the other levels tell
+   how much room is left in frames and swap together. */
+enum vm_pressure {
+	VM_PRESSURE_NONE,           /* Pages are not being evicted. */
+	VM_PRESSURE_LOW,            /* Evicting, plenty of swap left. */
+	VM_PRESSURE_MEDIUM,         /* Under 1/4 of memory and swap left. */
+	VM_PRESSURE_CRITICAL,       /* Under 1/16 left, processes may be killed. */
+};
+
+#endif /* lib/vmstat.h */
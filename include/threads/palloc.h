@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -14,10 +15,17 @@ enum palloc_flags {
 /* Maximum number of pages to put in user pool. */
 extern size_t user_page_limit;
 
+/* Number of page colours, 0 if colouring is off. */
+extern size_t palloc_colors;
+
 uint64_t palloc_init (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
+void *palloc_get_large (enum palloc_flags);
+void *palloc_get_colored (enum palloc_flags, const void *upage);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_prezero_page (void);
+void palloc_user_stats (size_t *free_cnt, size_t *total_cnt);
 
 #endif /* threads/palloc.h */
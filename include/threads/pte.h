@@ -22,6 +22,8 @@
 #define PDXSHIFT  21UL
 #define PTXSHIFT  12UL
 
+#define LARGE_PGSIZE (1UL << PDXSHIFT)    /* Bytes mapped by a large PDE. */
+
 #define PML4(la)  ((((uint64_t) (la)) >> PML4SHIFT) & 0x1FF)
 #define PDPE(la) ((((uint64_t) (la)) >> PDPESHIFT) & 0x1FF)
 #define PDX(la)  ((((uint64_t) (la)) >> PDXSHIFT) & 0x1FF)
@@ -41,5 +43,7 @@
 #define PTE_U 0x4                        /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20                       /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40                       /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80                      /* 1=PDE maps a 2 MB page. */
+#define PTE_G 0x100                      /* 1=global, kept across CR3 loads. */
 
 #endif /* threads/pte.h */
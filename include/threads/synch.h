@@ -38,6 +38,22 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock {
+	struct lock lock;           /* Guards the fields below. */
+	struct condition readers;   /* Signaled when readers may enter. */
+	struct condition writers;   /* Signaled when a writer may enter. */
+	int reader_cnt;             /* Readers holding the lock. */
+	int writer_waiting;         /* Writers waiting for the lock. */
+	bool writer;                /* Held by a writer? */
+};
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
@@ -98,6 +98,8 @@ struct thread {
 	char name[16];                      /* Name (for debugging purposes). */
 	int priority;                       /* Priority. */
 
+	struct list_elem allelem;           /* List element for all threads list. */
+
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
 
@@ -132,6 +134,7 @@ struct thread {
 	struct child *child_info;			/* Information of this thread as someone's child */
 
 	struct file *running_file;
+	struct dir *cwd;					/* Working directory, NULL for the root. */
 #endif
 
 	void *stack_pointer;
@@ -182,6 +185,10 @@ const char *thread_name (void);
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
 
+/* Performs some operation on thread t, given auxiliary data AUX. */
+typedef void thread_action_func (struct thread *t, void *aux);
+void thread_foreach (thread_action_func *, void *);
+
 int thread_get_priority (void);
 int thread_get_priority_ori (void);
 void thread_set_priority (int);
@@ -9,16 +9,6 @@ struct fork_args {
     struct child *child_info;
 };
 
-#ifdef VM
-struct lazy_load_args {
-    struct file *file;
-    off_t ofs;
-    uint32_t read_bytes;
-    uint32_t zero_bytes;
-};
-bool lazy_load_segment (struct page *page, void *aux);
-#endif
-
 tid_t process_create_initd (const char *file_name);
 tid_t process_fork (const char *name, struct intr_frame *if_);
 int process_exec (void *f_name);
@@ -4,7 +4,6 @@
 #include <stdbool.h>
 #include "threads/interrupt.h"
 typedef int pid_t;
-// struct lock filesys_lock;
 
 void syscall_init (void);
 
@@ -22,12 +21,24 @@ int write (int fd, const void *buffer, unsigned size);
 void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
+bool chdir (const char *dir);
+bool mkdir (const char *dir);
+bool readdir (int fd, char *name);
+bool isdir (int fd);
+int inumber (int fd);
+int symlink (const char *target, const char *linkpath);
 
 #ifdef VM
 #include <stddef.h>
 #include "filesys/off_t.h"
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
+void *mmap_anon (void *addr, size_t length, int writable, int flags);
 void munmap (void *addr);
+struct vmstat;
+bool vmstat (struct vmstat *stat);
+int madvise (void *addr, size_t length, int advice);
+int msync (void *addr, size_t length);
+int mempressure (void);
 #endif
 
 #endif /* userprog/syscall.h */
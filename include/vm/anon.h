@@ -2,13 +2,17 @@
 #define VM_ANON_H
 #include "vm/vm.h"
 struct page;
+struct zswap_entry;
 enum vm_type;
 
 struct anon_page {
-    size_t slot_idx;
+    size_t slot_idx;                /* Swap slot, or BITMAP_ERROR. */
+    struct zswap_entry *zentry;     /* Compressed copy, or NULL. */
 };
 
 void vm_anon_init (void);
+void vm_anon_swap_stats (size_t *free_cnt, size_t *total_cnt);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void *do_mmap_anon (void *addr, size_t length, bool writable, bool shared);
 
 #endif
@@ -20,4 +20,7 @@ bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+bool do_msync (void *addr, size_t length);
+void file_sync_all (void);
+void vm_file_print_stats (void);
 #endif
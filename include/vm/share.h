@@ -0,0 +1,15 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+#include <stdbool.h>
+
+struct page;
+struct frame;
+struct share_entry;
+
+void vm_share_init (void);
+bool vm_share_candidate (struct page *page);
+bool vm_share_claim (struct page *page);
+void vm_share_release (struct frame *frame);
+void vm_share_print_stats (void);
+
+#endif
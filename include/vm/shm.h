@@ -0,0 +1,15 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+#include <stdbool.h>
+#include <stddef.h>
+
+struct page;
+struct shm;
+
+struct shm *shm_create (size_t page_cnt);
+struct shm *shm_reopen (struct shm *shm);
+void shm_close (struct shm *shm);
+bool shm_claim (struct page *page);
+void shm_print_stats (void);
+
+#endif
@@ -5,6 +5,7 @@
 #include "threads/palloc.h"
 #include <bitmap.h>
 #include <hash.h>
+#include <vmstat.h>
 
 enum vm_type {
 	/* page not initialized */
@@ -30,6 +31,9 @@ enum vm_type {
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
+#include "vm/vma.h"
+#include "vm/share.h"
+#include "vm/shm.h"
 #ifdef EFILESYS
 #include "filesys/page_cache.h"
 #endif
@@ -52,6 +56,8 @@ struct page {
 	/* Your implementation */
 	struct hash_elem hash_elem; /* Hash table element. */
 	bool writable;
+	struct vma *vma;            /* Area this page belongs to, or NULL. */
+	struct list_elem vma_elem;  /* Element of vma->pages. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -69,6 +75,9 @@ struct page {
 struct frame {
 	void *kva;
 	struct page *page;
+	struct thread *owner;       /* Process whose page table maps it. */
+	struct share_entry *share;  /* Entry if shared by processes, or NULL. */
+	struct shm *shm;            /* Shared anonymous object owning it, or NULL. */
 	struct list_elem frame_elem;
 };
 
@@ -93,6 +102,13 @@ struct page_operations {
  * All designs up to you for this. */
 struct supplemental_page_table {
 	struct hash spt_hash;
+	struct list vmas;           /* Areas, sorted by start address. */
+	struct vma *vma_cache;      /* Last area found by vma_find (). */
+	struct vmstat stats;        /* Paging statistics of the process. */
+	int64_t ws_sampled_at;      /* Tick of the last working set sample. */
+	size_t swapped;             /* Anonymous pages in swap. */
+	size_t oom_score;           /* Footprint, while the OOM killer runs. */
+	bool oom_killed;            /* Chosen by the OOM killer, exit at next trap. */
 };
 
 #include "threads/thread.h"
@@ -116,5 +132,18 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
 enum vm_type page_get_type (struct page *page);
+void vm_free_frame (struct frame *frame);
+struct frame *vm_get_unevictable_frame (void);
+bool vm_page_make_private (struct page *page);
+void vm_print_stats (void);
+
+/* -vmstat: print paging statistics of each process on exit. */
+extern bool vm_stat_on_exit;
+extern size_t stack_pregrow_pages;
+void vm_sample_working_set (void);
+void vm_get_stats (struct vmstat *stat);
+bool vm_madvise (void *addr, size_t length, int advice);
+int vm_pressure (void);
+void vm_print_process_stats (void);
 
 #endif  /* VM_VM_H */
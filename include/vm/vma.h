@@ -0,0 +1,55 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+#include <list.h>
+#include <madvise.h>
+#include "filesys/off_t.h"
+#include "vm/vm.h"
+
+struct page;
+struct file;
+struct supplemental_page_table;
+struct shm;
+enum vm_type;
+
+/* Virtual memory area.
+ * A contiguous, page aligned range of user virtual addresses that share
+ * the same backing (file and offset, or nothing) and permissions.
+ * `struct page's inside the area are created only on the first fault, so
+ * mapping a large region costs one VMA instead of one page per 4 kB. */
+struct vma {
+	void *start;                /* First page of the area. */
+	void *end;                  /* One past the last page of the area. */
+	enum vm_type type;          /* Type of the pages born in this area. */
+	bool writable;
+
+	struct file *file;          /* Backing file (owned), or NULL. */
+	off_t ofs;                  /* File offset that START maps to. */
+	size_t read_bytes;          /* Bytes read from FILE, the rest is zero. */
+	int advice;                 /* MADV_NORMAL, _RANDOM or _SEQUENTIAL. */
+	bool mapped;                /* Created by mmap (), so munmap () may remove it. */
+	struct shm *shm;            /* Shared anonymous object (owned), or NULL. */
+
+	struct list pages;          /* Pages already faulted in. */
+	struct list_elem elem;      /* Element of spt->vmas, sorted by START. */
+};
+
+/* The stack area is marked by VM_MARKER_0 in its type, which its pages
+ * inherit. */
+#define vma_is_stack(vma) (((vma)->type & VM_MARKER_0) != 0)
+
+void vma_init (struct supplemental_page_table *spt);
+struct vma *vma_insert (struct supplemental_page_table *spt, void *start,
+		size_t length, enum vm_type type, bool writable, struct file *file,
+		off_t ofs, size_t read_bytes);
+struct vma *vma_find (struct supplemental_page_table *spt, const void *va);
+bool vma_overlaps (struct supplemental_page_table *spt, void *start,
+		size_t length);
+bool vma_is_zero_fill (struct vma *vma, const void *va);
+struct page *vma_populate (struct vma *vma, void *va);
+void vma_attach_page (struct vma *vma, struct page *page);
+void vma_remove (struct supplemental_page_table *spt, struct vma *vma);
+bool vma_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src);
+void vma_kill (struct supplemental_page_table *spt);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+struct page;
+struct zswap_entry;
+
+/* Bytes of kernel heap the compressed swap tier may hold before the
+ * coldest pages are written back to the swap disk.  0 disables the tier. */
+extern size_t zswap_budget;
+
+void zswap_init (void);
+struct zswap_entry *zswap_store (struct page *page, const void *kva);
+void zswap_load (struct zswap_entry *entry, void *kva);
+void zswap_free (struct zswap_entry *entry);
+bool zswap_over_budget (void);
+struct page *zswap_evict (void *kva);
+void zswap_print_stats (void);
+
+#endif
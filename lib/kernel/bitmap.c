@@ -326,6 +326,22 @@ bitmap_write (const struct bitmap *b, struct file *file) {
 	off_t size = byte_cnt (b->bit_cnt);
 	return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the SIZE bytes at offset OFS of B's file image to the same
+   offset of FILE, stopping at the end of B.  Returns true if
+   successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file, size_t ofs,
+		size_t size) {
+	size_t total = byte_cnt (b->bit_cnt);
+
+	if (ofs >= total)
+		return true;
+	if (size > total - ofs)
+		size = total - ofs;
+	return file_write_at (file, (const uint8_t *) b->bits + ofs, size, ofs)
+		== (off_t) size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
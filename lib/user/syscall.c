@@ -54,7 +54,7 @@ static __inline int64_t syscall (uint64_t num_, uint64_t a1_, uint64_t a2_,
 			((uint64_t) ARG2), 0, 0, 0))
 
 #define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3) ( \
-		syscall(((uint64_t *) NUMBER), \
+		syscall(((uint64_t) NUMBER), \
 			((uint64_t) ARG0), \
 			((uint64_t) ARG1), \
 			((uint64_t) ARG2), \
@@ -150,11 +150,36 @@ mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
 	return (void *) syscall5 (SYS_MMAP, addr, length, writable, fd, offset);
 }
 
+void *
+mmap_anon (void *addr, size_t length, int writable, int flags) {
+	return (void *) syscall4 (SYS_MMAP_ANON, addr, length, writable, flags);
+}
+
 void
 munmap (void *addr) {
 	syscall1 (SYS_MUNMAP, addr);
 }
 
+bool
+vmstat (struct vmstat *stat) {
+	return syscall1 (SYS_VMSTAT, stat);
+}
+
+int
+madvise (void *addr, size_t length, int advice) {
+	return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+int
+msync (void *addr, size_t length) {
+	return syscall2 (SYS_MSYNC, addr, length);
+}
+
+int
+mempressure (void) {
+	return syscall0 (SYS_MEMPRESSURE);
+}
+
 bool
 chdir (const char *dir) {
 	return syscall1 (SYS_CHDIR, dir);
@@ -2,6 +2,7 @@
 use strict;
 use warnings;
 use tests::tests;
+our ($test);
 check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
 (lg-random) begin
 (lg-random) create "bazzle"
@@ -11,4 +12,13 @@ check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
 (lg-random) close "bazzle"
 (lg-random) end
 EOF
+
+# On FAT, the cursor and skip index of each open inode must save most
+# of the steps that walking every chain from its start would take.
+my (@output) = read_text_file ("$test.output");
+foreach (@output) {
+    next if !/^FAT chain: (\d+) lookups, (\d+) steps, (\d+) from the chain start$/;
+    fail "FAT chain lookups took $2 steps, from the start $3\n"
+      if $2 * 4 > $3;
+}
 pass;
@@ -0,0 +1,67 @@
+/* Keeps enough files in a directory for it to be hashed, then
+   creates and removes another file in it over and over, and
+   checks that the directory stops growing once its hash table
+   has been rebuilt a few times. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define KEEP_CNT 40
+#define WARMUP_CNT 300
+#define CHURN_CNT 1000
+
+/* Creates and removes "churn/tN" for N in [FIRST, FIRST + CNT). */
+static void
+churn (int first, int cnt)
+{
+  char name[32];
+  int i;
+
+  for (i = first; i < first + cnt; i++)
+    {
+      snprintf (name, sizeof name, "churn/t%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+      if (!remove (name))
+        fail ("remove \"%s\"", name);
+    }
+}
+
+void
+test_main (void) 
+{
+  char name[32];
+  int fd, size, i;
+
+  CHECK (mkdir ("churn"), "mkdir \"churn\"");
+  msg ("creating %d files", KEEP_CNT);
+  for (i = 0; i < KEEP_CNT; i++)
+    {
+      snprintf (name, sizeof name, "churn/k%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+    }
+
+  msg ("creating and removing a file %d times", WARMUP_CNT);
+  churn (0, WARMUP_CNT);
+  CHECK ((fd = open ("churn")) > 1, "open \"churn\"");
+  size = filesize (fd);
+
+  msg ("creating and removing a file %d more times", CHURN_CNT);
+  churn (WARMUP_CNT, CHURN_CNT);
+  if (filesize (fd) != size)
+    fail ("\"churn\" grew from %d to %d bytes", size, filesize (fd));
+  msg ("\"churn\" did not grow");
+  close (fd);
+
+  msg ("removing files");
+  for (i = 0; i < KEEP_CNT; i++)
+    {
+      snprintf (name, sizeof name, "churn/k%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\"", name);
+    }
+  CHECK (remove ("churn"), "remove \"churn\"");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-churn) begin
+(dir-churn) mkdir "churn"
+(dir-churn) creating 40 files
+(dir-churn) creating and removing a file 300 times
+(dir-churn) open "churn"
+(dir-churn) creating and removing a file 1000 more times
+(dir-churn) "churn" did not grow
+(dir-churn) removing files
+(dir-churn) remove "churn"
+(dir-churn) end
+EOF
+pass;
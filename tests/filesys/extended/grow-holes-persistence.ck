@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($contents) = "\0" x 65536;
+substr ($contents, $_, 4) = "hole" foreach 40000, 1000, 65532, 5120, 5632, 4608, 0;
+check_archive ({"testfile" => [$contents]});
+pass;
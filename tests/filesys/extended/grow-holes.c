@@ -0,0 +1,56 @@
+/* Creates a file with a large initial size, checks that it reads
+   as zeros, then writes a few bytes at scattered offsets, some in
+   neighboring sectors and some in the middle of a sector, and
+   checks that everything around them is still zero.  Then writes
+   the last sector of a file larger than the buffer cache and checks
+   that the sectors before it were not zeroed on the way, which would
+   push them out of the cache to disk. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[65536];
+
+static const int offsets[] = {40000, 1000, 65532, 5120, 5632, 4608, 0};
+
+/* Sectors of the second file, well over the 64 the cache holds. */
+#define BIG_SECTORS 256
+
+void
+test_main (void) 
+{
+  const char *file_name = "testfile";
+  long long write_cnt;
+  size_t i;
+  int fd;
+
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  check_file (file_name, buf, sizeof buf);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  msg ("write \"%s\" at scattered offsets", file_name);
+  for (i = 0; i < sizeof offsets / sizeof *offsets; i++)
+    {
+      memcpy (buf + offsets[i], "hole", 4);
+      seek (fd, offsets[i]);
+      if (write (fd, "hole", 4) != 4)
+        fail ("write at %d failed", offsets[i]);
+    }
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+
+  CHECK (create ("bigfile", BIG_SECTORS * 512), "create \"bigfile\"");
+  CHECK ((fd = open ("bigfile")) > 1, "open \"bigfile\"");
+  write_cnt = get_fs_disk_write_cnt ();
+  seek (fd, BIG_SECTORS * 512 - 4);
+  CHECK (write (fd, "hole", 4) == 4, "write end of \"bigfile\"");
+  write_cnt = get_fs_disk_write_cnt () - write_cnt;
+  if (write_cnt >= BIG_SECTORS / 4)
+    fail ("writing one sector wrote %lld sectors to disk", write_cnt);
+  msg ("holes before the write were left unwritten");
+  close (fd);
+  CHECK (remove ("bigfile"), "remove \"bigfile\"");
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-holes) begin
+(grow-holes) create "testfile"
+(grow-holes) open "testfile" for verification
+(grow-holes) verified contents of "testfile"
+(grow-holes) close "testfile"
+(grow-holes) open "testfile"
+(grow-holes) write "testfile" at scattered offsets
+(grow-holes) close "testfile"
+(grow-holes) open "testfile" for verification
+(grow-holes) verified contents of "testfile"
+(grow-holes) close "testfile"
+(grow-holes) create "bigfile"
+(grow-holes) open "bigfile"
+(grow-holes) write end of "bigfile"
+(grow-holes) holes before the write were left unwritten
+(grow-holes) remove "bigfile"
+(grow-holes) end
+EOF
+pass;
@@ -0,0 +1,73 @@
+/* Opens files thousands of times, keeping up to OPEN_MAX handles
+   open at once.  Each time, the file is opened twice and extended
+   by one byte through the first handle, and the second handle must
+   see the new length and byte, which holds only if both opens share
+   one in-memory inode. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 64
+#define OPEN_MAX 100
+#define OPEN_CNT 4000
+
+void
+test_main (void) 
+{
+  static int fds[OPEN_MAX];
+  char name[16];
+  int i;
+
+  CHECK (mkdir ("many"), "mkdir \"many\"");
+  msg ("creating %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "many/f%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+    }
+
+  msg ("opening files %d times", OPEN_CNT);
+  for (i = 0; i < OPEN_CNT; i += 2)
+    {
+      int slot = i % OPEN_MAX;
+      int file = (i / 2 * 7) % FILE_CNT;
+      char byte = i / 2, got;
+      int length;
+
+      if (i >= OPEN_MAX)
+        {
+          close (fds[slot]);
+          close (fds[slot + 1]);
+        }
+      snprintf (name, sizeof name, "many/f%d", file);
+      fds[slot] = open (name);
+      fds[slot + 1] = open (name);
+      if (fds[slot] < 2 || fds[slot + 1] < 2)
+        fail ("open \"%s\" number %d", name, i);
+
+      length = filesize (fds[slot]);
+      seek (fds[slot], length);
+      if (write (fds[slot], &byte, 1) != 1)
+        fail ("write \"%s\" number %d", name, i);
+      if (filesize (fds[slot + 1]) != length + 1)
+        fail ("\"%s\" grew through one handle but not the other", name);
+      seek (fds[slot + 1], length);
+      if (read (fds[slot + 1], &got, 1) != 1 || got != byte)
+        fail ("\"%s\" byte written through one handle not read through "
+              "the other", name);
+    }
+  for (i = 0; i < OPEN_MAX; i++)
+    close (fds[i]);
+
+  msg ("removing files");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "many/f%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\"", name);
+    }
+  CHECK (remove ("many"), "remove \"many\"");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(open-many) begin
+(open-many) mkdir "many"
+(open-many) creating 64 files
+(open-many) opening files 4000 times
+(open-many) removing files
+(open-many) remove "many"
+(open-many) end
+EOF
+pass;
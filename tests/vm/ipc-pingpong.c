@@ -0,0 +1,71 @@
+/* Bounces a counter between two processes through a one word
+   mailbox file.  Each side waits for its turn, touches every page
+   of a private buffer and passes the counter back, so every turn
+   costs a switch between address spaces and a warm or cold TLB.
+   Run with -pcid to compare switch cost with tagged TLB entries. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ROUNDS 50
+#define PAGES 64
+
+static char buf[PAGES * 4096];
+
+/* Returns the counter currently in the mailbox. */
+static int
+peek (int fd)
+{
+  int value;
+
+  seek (fd, 0);
+  if (read (fd, &value, sizeof value) != sizeof value)
+    fail ("read mailbox");
+  return value;
+}
+
+/* Stores VALUE in the mailbox. */
+static void
+post (int fd, int value)
+{
+  seek (fd, 0);
+  if (write (fd, &value, sizeof value) != sizeof value)
+    fail ("write mailbox");
+}
+
+/* Waits for VALUE, touches the buffer, then posts VALUE + 1. */
+static void
+play (int fd, int value)
+{
+  int i;
+
+  while (peek (fd) != value)
+    continue;
+  for (i = 0; i < PAGES; i++)
+    buf[i * 4096] += value;
+  post (fd, value + 1);
+}
+
+void
+test_main (void)
+{
+  pid_t pid;
+  int fd, i;
+
+  CHECK (create ("mailbox", sizeof (int)), "create \"mailbox\"");
+  CHECK ((fd = open ("mailbox")) > 1, "open \"mailbox\"");
+
+  pid = fork ("pong");
+  if (pid == 0)
+    {
+      for (i = 0; i < ROUNDS; i++)
+        play (fd, 2 * i + 1);
+      exit (0);
+    }
+
+  for (i = 0; i < ROUNDS; i++)
+    play (fd, 2 * i);
+  CHECK (wait (pid) == 0, "wait for pong");
+  CHECK (peek (fd) == 2 * ROUNDS, "%d round trips", ROUNDS);
+}
@@ -0,0 +1,30 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(ipc-pingpong) begin
+(ipc-pingpong) create "mailbox"
+(ipc-pingpong) open "mailbox"
+(ipc-pingpong) wait for pong
+(ipc-pingpong) 50 round trips
+(ipc-pingpong) end
+EOF
+
+# With PCIDs, nearly every switch between the two players keeps its
+# TLB: at least one per round trip, and more than are flushed.
+my (@output) = read_text_file ("$test.output");
+pass "PCID not supported, TLB reuse not measured"
+  if grep (/^PCID not supported/, @output);
+my ($kept, $flushed);
+foreach (@output) {
+    ($kept, $flushed) = ($1, $2)
+      if /^TLB: (\d+) switches kept their PCID, (\d+) flushed$/;
+}
+fail "missing TLB statistics\n" if !defined $kept;
+fail "only $kept switches kept their PCID, expected at least 50\n"
+  if $kept < 50;
+fail "$kept switches kept their PCID but $flushed flushed\n"
+  if $kept <= $flushed;
+pass;
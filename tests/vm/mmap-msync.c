@@ -0,0 +1,43 @@
+/* Writes through a file mapping, calls msync, and checks that a
+   read of the file through another descriptor sees the new data
+   while the mapping is still in place.  Also checks that msync
+   fails on memory that is not mapped. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE 8192
+
+static char expected[SIZE];
+static char actual[SIZE];
+
+void
+test_main (void)
+{
+  char *map = (char *) 0x10000000;
+  int map_fd, read_fd;
+  size_t i;
+
+  CHECK (create ("msync.txt", SIZE), "create \"msync.txt\"");
+  CHECK ((map_fd = open ("msync.txt")) > 1, "open \"msync.txt\"");
+  CHECK (mmap (map, SIZE, 1, map_fd, 0) == map, "mmap \"msync.txt\"");
+
+  for (i = 0; i < SIZE; i++)
+    expected[i] = 'a' + i % 26;
+  memcpy (map, expected, SIZE);
+  CHECK (msync (map, SIZE) == 0, "msync \"msync.txt\"");
+
+  CHECK ((read_fd = open ("msync.txt")) > 1, "open \"msync.txt\" again");
+  CHECK (read (read_fd, actual, SIZE) == SIZE, "read \"msync.txt\"");
+  if (memcmp (actual, expected, SIZE))
+    fail ("file does not hold the data written through the mapping");
+  msg ("file holds the data written through the mapping");
+
+  CHECK (msync ((char *) 0x20000000, 4096) == -1,
+         "msync unmapped memory (must return -1)");
+  munmap (map);
+  close (read_fd);
+  close (map_fd);
+}
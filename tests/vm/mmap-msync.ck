@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-msync) begin
+(mmap-msync) create "msync.txt"
+(mmap-msync) open "msync.txt"
+(mmap-msync) mmap "msync.txt"
+(mmap-msync) msync "msync.txt"
+(mmap-msync) open "msync.txt" again
+(mmap-msync) read "msync.txt"
+(mmap-msync) file holds the data written through the mapping
+(mmap-msync) msync unmapped memory (must return -1)
+(mmap-msync) end
+EOF
+pass;
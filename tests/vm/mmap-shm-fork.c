@@ -0,0 +1,51 @@
+/* Shares an anonymous MAP_SHARED mapping from mmap_anon with
+   children forked back to back, so that children exit and drop
+   their reference while the parent is still forking new ones.
+   Each child checks the parent's data and stores its own number
+   in the mapping, which the parent must then see. */
+
+#include <mman.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 8
+
+void
+test_main (void)
+{
+  int *shared = (int *) 0x10000000;
+  pid_t children[CHILD_CNT];
+  int i;
+
+  CHECK (mmap_anon (shared, 4096, 1, MAP_SHARED) == shared,
+         "mmap shared anonymous page");
+  shared[0] = 0x1234;
+
+  msg ("fork %d children", CHILD_CNT);
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      children[i] = fork ("child-shm");
+      if (children[i] == 0)
+        {
+          if (shared[0] != 0x1234)
+            exit (1);
+          shared[i + 1] = i + 1;
+          exit (0);
+        }
+      if (children[i] < 0)
+        fail ("fork failed");
+    }
+
+  msg ("wait for children");
+  for (i = 0; i < CHILD_CNT; i++)
+    if (wait (children[i]) != 0)
+      fail ("child %d failed", i);
+
+  for (i = 0; i < CHILD_CNT; i++)
+    if (shared[i + 1] != i + 1)
+      fail ("slot %d holds %d, expected %d", i + 1, shared[i + 1], i + 1);
+  msg ("children's stores are visible");
+  munmap (shared);
+}
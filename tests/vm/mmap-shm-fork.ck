@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-shm-fork) begin
+(mmap-shm-fork) mmap shared anonymous page
+(mmap-shm-fork) fork 8 children
+(mmap-shm-fork) wait for children
+(mmap-shm-fork) children's stores are visible
+(mmap-shm-fork) end
+EOF
+pass;
@@ -0,0 +1,58 @@
+/* Sums a 2 MB array column by column with a 64 kB stride, the
+   distance at which addresses fall into the same sets of a
+   typical physically indexed L2 cache, and checks the result
+   against a sequential pass.  Run with -colors so that the
+   frames behind consecutive pages are spread over all cache
+   colours, which keeps the rows of a column from evicting each
+   other.  Also checks that the frames have the colours of their
+   pages, which chance would give only one page in COLORS. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+#define STRIDE (64 * 1024)
+#define PASSES 4
+#define COLORS 16               /* Matches -colors in Make.tests. */
+
+static unsigned char buf[SIZE];
+
+void
+test_main (void)
+{
+  unsigned long expected = 0;
+  size_t col, i, matched = 0;
+  int pass;
+
+  msg ("initialize");
+  for (i = 0; i < SIZE; i++)
+    {
+      buf[i] = i % 251;
+      expected += buf[i];
+    }
+
+  for (i = 0; i < SIZE; i += 4096)
+    {
+      uintptr_t pa = (uintptr_t) get_phys_addr (buf + i);
+      uintptr_t va = (uintptr_t) (buf + i);
+      if (pa != 0 && (pa >> 12) % COLORS == (va >> 12) % COLORS)
+        matched++;
+    }
+  if (matched < SIZE / 4096 * 15 / 16)
+    fail ("only %zu of %d frames have the colour of their page",
+          matched, SIZE / 4096);
+  msg ("frames have the colours of their pages");
+
+  msg ("strided passes");
+  for (pass = 0; pass < PASSES; pass++)
+    {
+      unsigned long sum = 0;
+
+      for (col = 0; col < STRIDE; col++)
+        for (i = col; i < SIZE; i += STRIDE)
+          sum += buf[i];
+      if (sum != expected)
+        fail ("pass %d: sum is %lu, expected %lu", pass, sum, expected);
+    }
+}
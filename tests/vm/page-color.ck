@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-color) begin
+(page-color) initialize
+(page-color) frames have the colours of their pages
+(page-color) strided passes
+(page-color) end
+EOF
+pass;
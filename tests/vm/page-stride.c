@@ -0,0 +1,74 @@
+/* Compares the faults taken to touch every page of a 2 MB block
+   of anonymous memory that may be backed by one large page with
+   those taken for a block advised MADV_RANDOM, which gets 4 kB
+   pages only.  The first should need a small fraction of the
+   faults of the second.  Then strides over 64 MB of zero-filled
+   memory, one byte per page, writing each page and then reading
+   all of them back, so that large mappings are split and swapped
+   out page by page. */
+
+#include <mman.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024 * 1024)
+#define STRIDE 4096
+#define BLOCK (2 * 1024 * 1024)
+
+static char buf[SIZE];
+
+/* Writes one byte to every page of the BLOCK bytes at P and
+   returns the faults this took. */
+static uint64_t
+touch_block (char *p)
+{
+  struct vmstat before, after;
+  size_t i;
+
+  if (!vmstat (&before))
+    fail ("vmstat failed");
+  for (i = 0; i < BLOCK; i += STRIDE)
+    p[i] = 1;
+  if (!vmstat (&after))
+    fail ("vmstat failed");
+  return (after.minor_faults + after.major_faults)
+         - (before.minor_faults + before.major_faults);
+}
+
+void
+test_main (void)
+{
+  char *large = (char *) 0x10000000;
+  char *small = (char *) 0x10400000;
+  uint64_t large_faults, small_faults;
+  size_t i;
+
+  CHECK (mmap (large, BLOCK, 1, MAP_ANON_FD, 0) == large,
+         "mmap block for large pages");
+  CHECK (mmap (small, BLOCK, 1, MAP_ANON_FD, 0) == small,
+         "mmap block for small pages");
+  CHECK (madvise (small, BLOCK, MADV_RANDOM) == 0, "madvise MADV_RANDOM");
+  large_faults = touch_block (large);
+  small_faults = touch_block (small);
+  if (small_faults < BLOCK / STRIDE)
+    fail ("%llu faults for %d small pages",
+          (unsigned long long) small_faults, BLOCK / STRIDE);
+  if (large_faults * 8 > small_faults)
+    fail ("%llu faults with large pages, %llu without",
+          (unsigned long long) large_faults,
+          (unsigned long long) small_faults);
+  msg ("large pages take fewer faults");
+  munmap (large);
+  munmap (small);
+
+  msg ("write pass");
+  for (i = 0; i < SIZE; i += STRIDE)
+    buf[i] = i / STRIDE;
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i += STRIDE)
+    if (buf[i] != (char) (i / STRIDE))
+      fail ("byte %zu is %d, expected %d", i, buf[i], (char) (i / STRIDE));
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-stride) begin
+(page-stride) mmap block for large pages
+(page-stride) mmap block for small pages
+(page-stride) madvise MADV_RANDOM
+(page-stride) large pages take fewer faults
+(page-stride) write pass
+(page-stride) read pass
+(page-stride) end
+EOF
+pass;
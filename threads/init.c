@@ -31,11 +31,14 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/zswap.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
+#include "filesys/buffer_cache.h"
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
@@ -49,6 +52,9 @@ static bool format_filesys;
 /* -q: Power off after kernel tasks complete? */
 bool power_off_when_done;
 
+/* -pcid: Tag TLB entries with PCIDs and make kernel mappings global? */
+static bool use_pcid;
+
 bool thread_tests;
 
 static void bss_init (void);
@@ -152,10 +158,21 @@ paging_init (uint64_t mem_end) {
 	extern char start, _end_kernel_text;
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
+	// Whole 2 MB blocks are mapped with one PDE each, except those
+	// holding kernel text, which is mapped read-only page by page.
 	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
 		uint64_t va = (uint64_t) ptov(pa);
 
-		perm = PTE_P | PTE_W;
+		if (pa % LARGE_PGSIZE == 0 && pa + LARGE_PGSIZE <= mem_end
+				&& (va + LARGE_PGSIZE <= (uint64_t) &start
+					|| va >= (uint64_t) &_end_kernel_text)) {
+			if ((pte = pml4_pde_walk (pml4, va, 1)) != NULL)
+				*pte = pa | PTE_PS | PTE_P | PTE_W | (use_pcid ? PTE_G : 0);
+			pa += LARGE_PGSIZE - PGSIZE;
+			continue;
+		}
+
+		perm = PTE_P | PTE_W | (use_pcid ? PTE_G : 0);
 		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
 			perm &= ~PTE_W;
 
@@ -165,6 +182,9 @@ paging_init (uint64_t mem_end) {
 
 	// reload cr3
 	pml4_activate(0);
+
+	if (use_pcid && !pml4_enable_pcid ())
+		printf ("PCID not supported by this CPU, using global pages only.\n");
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -216,6 +236,8 @@ parse_options (char **argv) {
 #ifdef FILESYS
 		else if (!strcmp (name, "-f"))
 			format_filesys = true;
+		else if (!strcmp (name, "-bcache"))
+			buffer_cache_size = atoi (value);
 #endif
 		else if (!strcmp (name, "-rs"))
 			random_init (atoi (value));
@@ -224,8 +246,20 @@ parse_options (char **argv) {
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
+		else if (!strcmp (name, "-colors"))
+			palloc_colors = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+		else if (!strcmp (name, "-pcid"))
+			use_pcid = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-vmstat"))
+			vm_stat_on_exit = true;
+		else if (!strcmp (name, "-zswap"))
+			zswap_budget = (size_t) atoi (value) * 1024;
+		else if (!strcmp (name, "-stack-pregrow"))
+			stack_pregrow_pages = atoi (value);
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -326,8 +360,18 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+#ifdef FILESYS
+			"  -bcache=N          Cache N disk sectors of the file system.\n"
+#endif
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+			"  -colors=N          Colour user frames with N cache colours.\n"
+			"  -pcid              Keep TLB entries across process switches.\n"
+#endif
+#ifdef VM
+			"  -vmstat            Print paging statistics of each process on exit.\n"
+			"  -zswap=KB          Compressed swap budget, 0 to disable.\n"
+			"  -stack-pregrow=N   Stack pages mapped ahead of a growth fault.\n"
 #endif
 			);
 	power_off ();
@@ -356,10 +400,16 @@ print_stats (void) {
 	thread_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	buffer_cache_print_stats ();
+	inode_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
+	pml4_print_stats ();
+#endif
+#ifdef VM
+	vm_print_stats ();
 #endif
 }
@@ -1,19 +1,164 @@
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Tagged TLB.  Once pml4_enable_pcid() succeeds, each of the last
+ * PCID_CNT address spaces to run keeps its TLB entries across switches,
+ * tagged with its slot number + 1; base_pml4 uses PCID 0.  An address
+ * space without a slot takes the next one round robin and is loaded
+ * without CR3_NOFLUSH, which drops the entries its previous owner left
+ * under that PCID. */
+#define PCID_CNT 64
+#define CR3_NOFLUSH (1UL << 63)
+#define CR4_PGE (1UL << 7)
+#define CR4_PCIDE (1UL << 17)
+#define CPUID_PGE (1U << 13)           /* CPUID.1:EDX. */
+#define CPUID_PCID (1U << 17)          /* CPUID.1:ECX. */
+
+static bool pcid_enabled;
+static uint64_t *pcid_owner[PCID_CNT];  /* Address space of each slot. */
+static size_t pcid_next;                /* Next slot to recycle. */
+static size_t pcid_hits;                /* Switches that kept the TLB. */
+static size_t pcid_misses;              /* Switches that flushed it. */
+
+/* Returns the CR3 PCID and no-flush bits to activate PML4 with. */
+static uint64_t
+pcid_tag (uint64_t *pml4) {
+	enum intr_level old_level;
+	uint64_t tag;
+	size_t i;
+
+	if (pml4 == base_pml4)
+		return CR3_NOFLUSH;
+
+	old_level = intr_disable ();
+	for (i = 0; i < PCID_CNT; i++)
+		if (pcid_owner[i] == pml4)
+			break;
+	if (i < PCID_CNT) {
+		tag = CR3_NOFLUSH | (i + 1);
+		pcid_hits++;
+	} else {
+		i = pcid_next;
+		pcid_next = (pcid_next + 1) % PCID_CNT;
+		pcid_owner[i] = pml4;
+		tag = i + 1;
+		pcid_misses++;
+	}
+	intr_set_level (old_level);
+	return tag;
+}
+
+/* Takes the slot of PML4 away, so that the TLB entries tagged with it
+ * are dropped the next time PML4 is activated.  Used when an inactive
+ * address space changes, since invlpg only reaches the current PCID. */
+static void
+pcid_forget (uint64_t *pml4) {
+	enum intr_level old_level;
+
+	if (!pcid_enabled)
+		return;
+	old_level = intr_disable ();
+	for (size_t i = 0; i < PCID_CNT; i++)
+		if (pcid_owner[i] == pml4)
+			pcid_owner[i] = NULL;
+	intr_set_level (old_level);
+}
+
+/* Returns true if PML4 is the address space loaded in CR3. */
+static bool
+pml4_is_active (uint64_t *pml4) {
+	return PTE_ADDR (rcr3 ()) == vtop (pml4);
+}
+
+/* Flushes the TLB entry for user page VA of PML4. */
+static void
+tlb_flush_page (uint64_t *pml4, uint64_t va) {
+	if (pml4_is_active (pml4))
+		invlpg (va);
+	else
+		pcid_forget (pml4);
+}
+
+/* Page tables set aside for splitting the 2 MB mappings, one for each
+ * large PDE in use, chained through their first word.  A split needs
+ * one exactly when it cannot fail, e.g. to unmap a page being evicted,
+ * so it is taken when the large page is mapped instead. */
+static void *split_reserve;
+static size_t split_reserve_cnt;
+
+/* Adds page table PT to the split reserve. */
+static void
+split_reserve_put (void *pt) {
+	enum intr_level old_level = intr_disable ();
+	*(void **) pt = split_reserve;
+	split_reserve = pt;
+	split_reserve_cnt++;
+	intr_set_level (old_level);
+}
+
+/* Takes a page table from the split reserve, or returns NULL if it is
+ * empty. */
+static void *
+split_reserve_get (void) {
+	enum intr_level old_level = intr_disable ();
+	void *pt = split_reserve;
+	if (pt != NULL) {
+		split_reserve = *(void **) pt;
+		split_reserve_cnt--;
+	}
+	intr_set_level (old_level);
+	return pt;
+}
+
+/* Returns one page table of the split reserve to the kernel pool, as a
+ * large PDE goes away without being split. */
+static void
+split_reserve_release (void) {
+	void *pt = split_reserve_get ();
+	if (pt != NULL)
+		palloc_free_page (pt);
+}
+
+/* Replaces the large PDE at PDE by a page table that maps the same 2 MB
+ * with 512 PTEs carrying the same flags.  The translation of every address
+ * is unchanged, so no TLB flush is needed here; the caller flushes the
+ * page it is about to modify.  The page table comes from the split
+ * reserve.  Returns false, changing nothing, if none is left and none
+ * can be allocated. */
+static bool
+pde_split (uint64_t *pde) {
+	uint64_t *pt = split_reserve_get ();
+	uint64_t pa = PTE_ADDR (*pde) & ~(LARGE_PGSIZE - 1);
+	uint64_t flags = *pde & PTE_FLAGS & ~PTE_PS;
+
+	if (pt == NULL && (pt = palloc_get_page (0)) == NULL)
+		return false;
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		pt[i] = (pa + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+	return true;
+}
+
+/* A large PDE is split only when CREATE is set, since the caller is
+ * about to change the PTE; otherwise the walk ends there with NULL. */
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
 	if (pdp) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
-		if (!((uint64_t) pte & PTE_P)) {
+		if ((uint64_t) pte & PTE_PS) {
+			if (!create || !pde_split (&pdp[idx]))
+				return NULL;
+		} else if (!((uint64_t) pte & PTE_P)) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
 				if (new_page)
@@ -88,6 +233,55 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Returns the address of the page directory entry for virtual
+ * address VA in PML4, creating the upper levels if CREATE is true.
+ * The entry itself may be empty, point to a page table, or map a
+ * 2 MB page. */
+uint64_t *
+pml4_pde_walk (uint64_t *pml4, const uint64_t va, int create) {
+	uint64_t *e = &pml4[PML4 (va)];
+
+	for (int level = 0; level < 2; level++) {
+		if (!(*e & PTE_P)) {
+			uint64_t *new_page;
+			if (!create || (new_page = palloc_get_page (PAL_ZERO)) == NULL)
+				return NULL;
+			*e = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+		}
+		uint64_t *table = ptov (PTE_ADDR (*e));
+		e = &table[level == 0 ? PDPE (va) : PDX (va)];
+	}
+	return e;
+}
+
+/* Returns the entry that maps VA in PML4 without changing the
+ * tables: the PTE, or the PDE itself if VA lies in a 2 MB page.
+ * Returns a null pointer if there is none. */
+static uint64_t *
+pml4_lookup (uint64_t *pml4, const uint64_t va) {
+	uint64_t *pde = pml4_pde_walk (pml4, va, false);
+
+	if (pde == NULL || !(*pde & PTE_P))
+		return NULL;
+	if (*pde & PTE_PS)
+		return pde;
+	return (uint64_t *) ptov (PTE_ADDR (*pde)) + PTX (va);
+}
+
+/* Returns the PTE that maps VA in PML4, about to be changed, without
+ * creating tables.  A 2 MB page around VA is split first.  Returns a
+ * null pointer if there is no page table for VA or the split fails. */
+static uint64_t *
+pml4_pte_for_update (uint64_t *pml4, const uint64_t va) {
+	uint64_t *pde = pml4_pde_walk (pml4, va, false);
+
+	if (pde == NULL || !(*pde & PTE_P))
+		return NULL;
+	if ((*pde & PTE_PS) && !pde_split (pde))
+		return NULL;
+	return (uint64_t *) ptov (PTE_ADDR (*pde)) + PTX (va);
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -122,7 +316,13 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if (pdp[i] & PTE_PS) {
+			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+								 ((uint64_t) pdp_index << PDPESHIFT) |
+								 ((uint64_t) i << PDXSHIFT));
+			if (!func (&pdp[i], va, aux))
+				return false;
+		} else if (((uint64_t) pte) & PTE_P)
 			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
@@ -169,7 +369,12 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if (pdp[i] & PTE_PS)
+			/* The frames of a 2 MB block belong to the struct frame of
+			 * each page and are freed with the pages; only the page
+			 * table set aside to split the block goes here. */
+			split_reserve_release ();
+		else if (((uint64_t) pte) & PTE_P)
 			pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
@@ -196,6 +401,7 @@ pml4_destroy (uint64_t *pml4) {
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
 	if (((uint64_t) pdpe) & PTE_P)
 		pdpe_destroy ((void *) PTE_ADDR (pdpe));
+	pcid_forget (pml4);
 	palloc_free_page ((void *) pml4);
 }
 
@@ -203,7 +409,38 @@ pml4_destroy (uint64_t *pml4) {
  * register. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+	lcr3 (vtop (pml4) | (pcid_enabled ? pcid_tag (pml4) : 0));
+}
+
+/* Turns on global pages and, if the CPU has them, PCIDs, so that
+ * pml4_activate() stops flushing the whole TLB.  Must be called with
+ * base_pml4 active; its kernel mappings should carry PTE_G.  Returns
+ * true if PCIDs are in use. */
+bool
+pml4_enable_pcid (void) {
+	uint32_t eax = 1, ebx, ecx, edx;
+
+	asm volatile ("cpuid"
+			: "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "c" (0));
+	if (edx & CPUID_PGE)
+		lcr4 (rcr4 () | CR4_PGE);
+	if (!(ecx & CPUID_PCID))
+		return false;
+
+	ASSERT (rcr3 () == vtop (base_pml4));
+	lcr4 (rcr4 () | CR4_PCIDE);
+	pcid_enabled = true;
+	return true;
+}
+
+/* Prints PCID statistics. */
+void
+pml4_print_stats (void) {
+	if (pcid_enabled)
+		printf ("TLB: %zu switches kept their PCID, %zu flushed\n",
+				pcid_hits, pcid_misses);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -214,8 +451,11 @@ void *
 pml4_get_page (uint64_t *pml4, const void *uaddr) {
 	ASSERT (is_user_vaddr (uaddr));
 
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
+	uint64_t *pte = pml4_lookup (pml4, (uint64_t) uaddr);
 
+	if (pte && (*pte & PTE_PS))
+		return ptov (PTE_ADDR (*pte) & ~(LARGE_PGSIZE - 1))
+			+ ((uint64_t) uaddr & (LARGE_PGSIZE - 1));
 	if (pte && (*pte & PTE_P))
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
 	return NULL;
@@ -243,6 +483,43 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 	return pte != NULL;
 }
 
+/* Maps the 2 MB of user virtual memory at UPAGE to the 2 MB of
+ * physically contiguous frames at KPAGE with a single PDE.  Both
+ * must be 2 MB aligned and no page of the range may be mapped yet;
+ * an empty page table left over from earlier mappings is kept as the
+ * one reserved for splitting.
+ * The mapping is split back into 4 kB pages the first time one of
+ * its pages is changed through pml4_set_page (), pml4_clear_page ()
+ * or the other per page functions, with a page table reserved here.
+ * Returns true if successful, false if memory allocation failed or
+ * part of the range is mapped. */
+bool
+pml4_set_large_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	ASSERT ((uint64_t) upage % LARGE_PGSIZE == 0);
+	ASSERT ((uint64_t) kpage % LARGE_PGSIZE == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	uint64_t *pde = pml4_pde_walk (pml4, (uint64_t) upage, 1);
+	uint64_t *pt;
+	if (pde == NULL)
+		return false;
+	if (*pde & PTE_P) {
+		pt = ptov (PTE_ADDR (*pde));
+		if (*pde & PTE_PS)
+			return false;
+		for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+			if (pt[i] & PTE_P)
+				return false;
+		*pde = 0;
+	} else if ((pt = palloc_get_page (0)) == NULL)
+		return false;
+	split_reserve_put (pt);
+	*pde = vtop (kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	tlb_flush_page (pml4, (uint64_t) upage);
+	return true;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
@@ -253,12 +530,123 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (is_user_vaddr (upage));
 
-	pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	pte = pml4_lookup (pml4, (uint64_t) upage);
+	if (pte != NULL && (*pte & PTE_P) != 0
+			&& (*pte & PTE_PS) != 0)
+		pte = pml4_pte_for_update (pml4, (uint64_t) upage);
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		tlb_flush_page (pml4, (uint64_t) upage);
+	}
+}
+
+/* Up to this many pages are flushed one by one with invlpg when a
+ * range is unmapped; beyond it, reloading CR3 is cheaper. */
+#define FLUSH_BATCH 32
+
+/* Pages waiting to be flushed from the TLB by pml4_clear_range(). */
+struct range_flush {
+	uint64_t va[FLUSH_BATCH];   /* Pages to invlpg. */
+	size_t cnt;                 /* Number of them. */
+	bool reload;                /* Too many pages: reload CR3 instead. */
+};
+
+static void
+flush_add (struct range_flush *fl, uint64_t va) {
+	if (fl->cnt < FLUSH_BATCH)
+		fl->va[fl->cnt++] = va;
+	else
+		fl->reload = true;
+}
+
+static bool
+table_is_empty (const uint64_t *table) {
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		if (table[i] & PTE_P)
+			return false;
+	return true;
+}
+
+/* Clears the entries of TABLE, a page table of LEVEL (0 for a PT,
+ * up to 3 for the PML4), that map [START, END), descending into
+ * lower tables and freeing those left empty if MAY_FREE.  Large
+ * pages only partly in the range are split first. */
+static void
+table_clear_range (uint64_t *table, int level, uint64_t start, uint64_t end,
+		bool may_free, struct range_flush *fl) {
+	unsigned shift = PTXSHIFT + 9 * level;
+	uint64_t size = 1UL << shift;
+	uint64_t va = start;
+
+	while (va < end) {
+		uint64_t *e = &table[(va >> shift) & 0x1FF];
+		uint64_t next = (va & ~(size - 1)) + size;
+		uint64_t lim = next < end ? next : end;
+
+		if (*e & PTE_P) {
+			bool leaf = level == 0 || (level == 1 && (*e & PTE_PS));
+			bool whole = (va & (size - 1)) == 0 && lim == next;
+
+			if (leaf && whole) {
+				if (level == 1)
+					split_reserve_release ();
+				*e = 0;
+				flush_add (fl, va);
+			} else if (leaf) {
+				if (!pde_split (e))
+					PANIC ("no page table to split a large page");
+				continue;
+			} else {
+				uint64_t *child = ptov (PTE_ADDR (*e));
+				table_clear_range (child, level - 1, va, lim, may_free, fl);
+				if (may_free && table_is_empty (child)) {
+					*e = 0;
+					palloc_free_page (child);
+					flush_add (fl, va);
+				}
+			}
+		}
+		va = lim;
+	}
+}
+
+/* Unmaps every user page in [START, END) from PML4 at once and
+ * frees the page tables left empty.  Large pages only partly in
+ * the range are split first.  If PML4 is active, the TLB is then
+ * flushed once: page by page for a few pages, by reloading CR3
+ * otherwise.  Unlike pml4_clear_page(), the entries are zeroed,
+ * so their dirty and accessed bits are lost; read them first.
+ * The frames themselves are not freed. */
+void
+pml4_clear_range (uint64_t *pml4, void *start, void *end) {
+	struct range_flush fl = { .cnt = 0, .reload = false };
+
+	ASSERT (pg_ofs (start) == 0 && pg_ofs (end) == 0);
+	ASSERT (start <= end && (end == start || is_user_vaddr (end - 1)));
+	ASSERT (pml4 != base_pml4);
+
+	/* Only the tables below PML4 entry 0 belong to the process alone,
+	 * as in pml4_destroy(); the others are shared with the kernel. */
+	for (uint64_t va = (uint64_t) start; va < (uint64_t) end; ) {
+		uint64_t next = (va & ~((1UL << PML4SHIFT) - 1)) + (1UL << PML4SHIFT);
+		uint64_t lim = next < (uint64_t) end ? next : (uint64_t) end;
+		uint64_t *pml4e = &pml4[PML4 (va)];
+
+		if (*pml4e & PTE_P)
+			table_clear_range (ptov (PTE_ADDR (*pml4e)), 2, va, lim,
+					PML4 (va) == 0, &fl);
+		va = lim;
+	}
+
+	if (!pml4_is_active (pml4))
+		pcid_forget (pml4);
+	else {
+		if (fl.reload)
+			lcr3 (rcr3 ());
+		else
+			for (size_t i = 0; i < fl.cnt; i++)
+				invlpg (fl.va[i]);
 	}
 }
 
@@ -268,7 +656,7 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
  * Returns false if PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_dirty (uint64_t *pml4, const void *vpage) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = pml4_lookup (pml4, (uint64_t) vpage);
 	return pte != NULL && (*pte & PTE_D) != 0;
 }
 
@@ -276,15 +664,16 @@ pml4_is_dirty (uint64_t *pml4, const void *vpage) {
  * in PML4. */
 void
 pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = pml4_lookup (pml4, (uint64_t) vpage);
+	if (pte != NULL && (*pte & PTE_PS) && ((*pte & PTE_D) != 0) != dirty)
+		pte = pml4_pte_for_update (pml4, (uint64_t) vpage);
 	if (pte) {
 		if (dirty)
 			*pte |= PTE_D;
 		else
 			*pte &= ~(uint32_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_flush_page (pml4, (uint64_t) vpage);
 	}
 }
 
@@ -294,22 +683,22 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
  * PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_accessed (uint64_t *pml4, const void *vpage) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = pml4_lookup (pml4, (uint64_t) vpage);
 	return pte != NULL && (*pte & PTE_A) != 0;
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD.  In a 2 MB page the bit is shared by the whole
+   mapping, which is left intact. */
 void
 pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = pml4_lookup (pml4, (uint64_t) vpage);
 	if (pte) {
 		if (accessed)
 			*pte |= PTE_A;
 		else
 			*pte &= ~(uint32_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_flush_page (pml4, (uint64_t) vpage);
 	}
 }
@@ -8,7 +8,9 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/pte.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -38,11 +40,29 @@ static struct pool kernel_pool, user_pool;
 
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
+
+/* Number of page colours for palloc_get_colored(), 0 to disable.
+   Two pages of the same colour compete for the same sets of a
+   physically indexed cache of PALLOC_COLORS * PGSIZE bytes per
+   way. */
+size_t palloc_colors;
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
 
+/* User pages zeroed ahead of time by the idle thread, so that
+   PAL_USER | PAL_ZERO requests (page faults, new stacks) skip the
+   memset.  Pages here are marked used in user_pool's bitmap.
+   Only the idle thread pushes; anyone may pop, with interrupts
+   off. */
+#define PREZERO_PAGES 64
+static void *prezeroed[PREZERO_PAGES];
+static size_t prezeroed_cnt;
+
+static void *prezeroed_pop (void);
+static void *prezeroed_pop_colored (size_t color);
+
 /* multiboot info */
 struct multiboot_info {
 	uint32_t flags;
@@ -262,19 +282,28 @@ palloc_init (void) {
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	bool single_user = (flags & PAL_USER) && page_cnt == 1;
+	void *pages;
+
+	if (single_user && (flags & PAL_ZERO)) {
+		pages = prezeroed_pop ();
+		if (pages != NULL)
+			return pages;
+	}
 
 	lock_acquire (&pool->lock);
 	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
 	lock_release (&pool->lock);
-	void *pages;
 
 	if (page_idx != BITMAP_ERROR)
 		pages = pool->base + PGSIZE * page_idx;
+	else if (single_user)
+		pages = prezeroed_pop ();
 	else
 		pages = NULL;
 
 	if (pages) {
-		if (flags & PAL_ZERO)
+		if ((flags & PAL_ZERO) && page_idx != BITMAP_ERROR)
 			memset (pages, 0, PGSIZE * page_cnt);
 	} else {
 		if (flags & PAL_ASSERT)
@@ -284,6 +313,39 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	return pages;
 }
 
+/* Obtains LARGE_PGSIZE / PGSIZE contiguous free pages that start
+   on a LARGE_PGSIZE boundary, so that they can be mapped with a
+   single large page directory entry.  FLAGS are interpreted as
+   by palloc_get_multiple().  The pages may be freed one by one
+   or together. */
+void *
+palloc_get_large (enum palloc_flags flags) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t page_cnt = LARGE_PGSIZE / PGSIZE;
+	uint64_t base = (uint64_t) pool->base;
+	size_t page_idx = (ROUND_UP (base, LARGE_PGSIZE) - base) / PGSIZE;
+	void *pages = NULL;
+
+	lock_acquire (&pool->lock);
+	for (; page_idx + page_cnt <= bitmap_size (pool->used_map);
+			page_idx += page_cnt)
+		if (bitmap_none (pool->used_map, page_idx, page_cnt)) {
+			bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+			pages = pool->base + PGSIZE * page_idx;
+			break;
+		}
+	lock_release (&pool->lock);
+
+	if (pages) {
+		if (flags & PAL_ZERO)
+			memset (pages, 0, LARGE_PGSIZE);
+	} else {
+		if (flags & PAL_ASSERT)
+			PANIC ("palloc_get_large: out of pages");
+	}
+	return pages;
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -296,6 +358,55 @@ palloc_get_page (enum palloc_flags flags) {
 	return palloc_get_multiple (flags, 1);
 }
 
+/* Returns the colour of the page at kernel address KPAGE. */
+static size_t
+page_color (void *kpage) {
+	return pg_no (vtop (kpage)) % palloc_colors;
+}
+
+/* Obtains a single free user page for user virtual address
+   UPAGE, preferring one whose colour matches UPAGE's, so that
+   consecutive virtual pages are spread over the cache instead
+   of wherever the lowest free frames happen to fall.  Falls
+   back to any page if none of that colour is free.  FLAGS are
+   interpreted as by palloc_get_page() and must include
+   PAL_USER. */
+void *
+palloc_get_colored (enum palloc_flags flags, const void *upage) {
+	struct pool *pool = &user_pool;
+	size_t color, page_idx, first;
+	void *page = NULL;
+
+	ASSERT (flags & PAL_USER);
+	if (palloc_colors == 0)
+		return palloc_get_page (flags);
+	color = pg_no (upage) % palloc_colors;
+
+	if (flags & PAL_ZERO) {
+		page = prezeroed_pop_colored (color);
+		if (page != NULL)
+			return page;
+	}
+
+	first = (color + palloc_colors
+			- pg_no (vtop (pool->base)) % palloc_colors) % palloc_colors;
+	lock_acquire (&pool->lock);
+	for (page_idx = first; page_idx < bitmap_size (pool->used_map);
+			page_idx += palloc_colors)
+		if (!bitmap_test (pool->used_map, page_idx)) {
+			bitmap_mark (pool->used_map, page_idx);
+			page = pool->base + PGSIZE * page_idx;
+			break;
+		}
+	lock_release (&pool->lock);
+
+	if (page == NULL)
+		return palloc_get_page (flags);
+	if (flags & PAL_ZERO)
+		memset (page, 0, PGSIZE);
+	return page;
+}
+
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) {
@@ -328,6 +439,87 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Fills PAGE with zeros using non-temporal stores, so that
+   zeroing in the background does not push the running
+   program's working set out of the cache. */
+static void
+zero_page_nt (void *page) {
+	uint64_t *p = page;
+	size_t i;
+
+	for (i = 0; i < PGSIZE / sizeof *p; i += 4)
+		asm volatile ("movnti %1, 0(%0)\n"
+				"movnti %1, 8(%0)\n"
+				"movnti %1, 16(%0)\n"
+				"movnti %1, 24(%0)"
+				: : "r" (p + i), "r" ((uint64_t) 0) : "memory");
+	asm volatile ("sfence" : : : "memory");
+}
+
+/* Takes a page from the pre-zeroed pool, or returns a null
+   pointer if it is empty. */
+static void *
+prezeroed_pop (void) {
+	enum intr_level old_level = intr_disable ();
+	void *page = prezeroed_cnt > 0 ? prezeroed[--prezeroed_cnt] : NULL;
+	intr_set_level (old_level);
+	return page;
+}
+
+/* Takes a page of COLOR from the pre-zeroed pool, or returns a
+   null pointer if it holds none. */
+static void *
+prezeroed_pop_colored (size_t color) {
+	enum intr_level old_level = intr_disable ();
+	void *page = NULL;
+
+	for (size_t i = 0; i < prezeroed_cnt; i++)
+		if (page_color (prezeroed[i]) == color) {
+			page = prezeroed[i];
+			prezeroed[i] = prezeroed[--prezeroed_cnt];
+			break;
+		}
+	intr_set_level (old_level);
+	return page;
+}
+
+/* Zeroes one free user page and adds it to the pre-zeroed pool.
+   Called by the idle thread, so it must never block: gives up
+   and returns false if the pool is full, the user pool is busy,
+   or no free user page is left. */
+bool
+palloc_prezero_page (void) {
+	if (prezeroed_cnt >= PREZERO_PAGES)
+		return false;
+	if (!lock_try_acquire (&user_pool.lock))
+		return false;
+	size_t page_idx = bitmap_scan_and_flip (user_pool.used_map, 0, 1, false);
+	lock_release (&user_pool.lock);
+	if (page_idx == BITMAP_ERROR)
+		return false;
+
+	void *page = user_pool.base + PGSIZE * page_idx;
+	zero_page_nt (page);
+
+	enum intr_level old_level = intr_disable ();
+	prezeroed[prezeroed_cnt++] = page;
+	intr_set_level (old_level);
+	return true;
+}
+
+/* Stores the number of free user pages, counting pre-zeroed ones,
+   in *FREE_CNT and the size of the user pool in *TOTAL_CNT. */
+void
+palloc_user_stats (size_t *free_cnt, size_t *total_cnt) {
+	size_t page_cnt = bitmap_size (user_pool.used_map);
+
+	lock_acquire (&user_pool.lock);
+	*free_cnt = bitmap_count (user_pool.used_map, 0, page_cnt, false);
+	lock_release (&user_pool.lock);
+	*free_cnt += prezeroed_cnt;
+	*total_cnt = page_cnt;
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -368,6 +368,68 @@ cond_broadcast (struct condition *cond, struct lock *lock) {
 		cond_signal (cond, lock);
 }
 
+/* Initializes RW, a readers-writer lock.  Any number of readers
+   may hold it at once, or else a single writer.  A waiting writer
+   keeps new readers out, so a stream of readers cannot starve
+   it. */
+void
+rwlock_init (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	lock_init (&rw->lock);
+	cond_init (&rw->readers);
+	cond_init (&rw->writers);
+	rw->reader_cnt = 0;
+	rw->writer_waiting = 0;
+	rw->writer = false;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   waits for it. */
+void
+rwlock_acquire_read (struct rwlock *rw) {
+	lock_acquire (&rw->lock);
+	while (rw->writer || rw->writer_waiting > 0)
+		cond_wait (&rw->readers, &rw->lock);
+	rw->reader_cnt++;
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rw) {
+	lock_acquire (&rw->lock);
+	ASSERT (rw->reader_cnt > 0);
+	if (--rw->reader_cnt == 0)
+		cond_signal (&rw->writers, &rw->lock);
+	lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no one else holds it. */
+void
+rwlock_acquire_write (struct rwlock *rw) {
+	lock_acquire (&rw->lock);
+	rw->writer_waiting++;
+	while (rw->writer || rw->reader_cnt > 0)
+		cond_wait (&rw->writers, &rw->lock);
+	rw->writer_waiting--;
+	rw->writer = true;
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rwlock_release_write (struct rwlock *rw) {
+	lock_acquire (&rw->lock);
+	ASSERT (rw->writer);
+	rw->writer = false;
+	if (rw->writer_waiting > 0)
+		cond_signal (&rw->writers, &rw->lock);
+	else
+		cond_broadcast (&rw->readers, &rw->lock);
+	lock_release (&rw->lock);
+}
+
 bool cmp_priority_sema(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED) {
 	struct semaphore_elem *s1 = list_entry(a, struct semaphore_elem, elem);
     struct semaphore_elem *s2 = list_entry(b, struct semaphore_elem, elem);
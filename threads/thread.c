@@ -34,6 +34,10 @@ static struct list ready_list;
 /* List of processes in sleep mode */
 static struct list sleep_list;
 
+/* List of all threads.  Threads are added to this list when they
+   are created and removed when they exit. */
+static struct list all_list;
+
 /* Idle thread. */
 static struct thread *idle_thread;
 
@@ -117,6 +121,7 @@ thread_init (void) {
 	list_init (&ready_list);
 	list_init (&sleep_list);
 	list_init (&destruction_req);
+	list_init (&all_list);
 
 	/* Set up a thread structure for the running thread. */
 	initial_thread = running_thread ();
@@ -307,6 +312,7 @@ thread_exit (void) {
 	/* Just set our status to dying and schedule another process.
 	   We will be destroyed during the call to schedule_tail(). */
 	intr_disable ();
+	list_remove (&thread_current ()->allelem);
 	do_schedule (THREAD_DYING);
 	NOT_REACHED ();
 }
@@ -329,6 +335,21 @@ thread_yield (void) {
 	intr_set_level (old_level);
 }
 
+/* Invoke function 'func' on all threads, passing along 'aux'.
+   This function must be called with interrupts off. */
+void
+thread_foreach (thread_action_func *func, void *aux) {
+	struct list_elem *e;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (e = list_begin (&all_list); e != list_end (&all_list);
+			e = list_next (e)) {
+		struct thread *t = list_entry (e, struct thread, allelem);
+		func (t, aux);
+	}
+}
+
 /* Sets the current thread's priority to NEW_PRIORITY. */
 void
 thread_set_priority (int new_priority) {
@@ -399,6 +420,13 @@ idle (void *idle_started_ UNUSED) {
 	sema_up (idle_started);
 
 	for (;;) {
+#ifdef USERPROG
+		/* Zero user frames ahead of page faults until someone
+		   else becomes ready. */
+		while (list_empty (&ready_list) && palloc_prezero_page ())
+			continue;
+#endif
+
 		/* Let someone else run. */
 		intr_disable ();
 		thread_block ();
@@ -447,6 +475,10 @@ init_thread (struct thread *t, const char *name, int priority) {
 	t->recent_cpu = RECENT_CPU_DEFAULT;
 	t->magic = THREAD_MAGIC;
 
+	enum intr_level old_level = intr_disable ();
+	list_push_back (&all_list, &t->allelem);
+	intr_set_level (old_level);
+
 	/* Initializes data structure for priority donation */
 	t->wait_on_lock = NULL;
 	list_init(&t->donations);
@@ -464,6 +496,7 @@ init_thread (struct thread *t, const char *name, int priority) {
 	t->parent = NULL;
 
 	t->running_file = NULL;
+	t->cwd = NULL;
 #endif
 }
 
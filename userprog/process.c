@@ -205,14 +205,16 @@ __do_fork (void *aux) {
 	/* Copy file descripters from parent to newly created process */
 	for (int i = 2; i < FILED_MAX; i++) {
 		if (parent->fdt[i] != NULL) {
-			lock_acquire(&filesys_lock);
 			struct file *dup = file_duplicate(parent->fdt[i]);
-			lock_release(&filesys_lock);
 			if (dup == NULL) goto error;
 			current->fdt[i] = dup;
 		}
 		else current->fdt[i] = NULL;
 	}
+	if (parent->cwd != NULL) {
+		current->cwd = dir_reopen(parent->cwd);
+		if (current->cwd == NULL) goto error;
+	}
 
 	// struct list_elem *e;
 	// for (e = list_begin(&parent->children); e != list_end(&parent->children); e = list_next(e)) {
@@ -351,21 +353,23 @@ process_exit (void) {
 	 * TODO: Implement process termination message (see
 	 * TODO: project2/process_termination.html).
 	 * TODO: We recommend you to implement process resource cleanup here. */
+#ifdef VM
+	if (vm_stat_on_exit && curr->pml4 != NULL)
+		vm_print_process_stats ();
+#endif
 
 	/* Close all file and deallocate the FDT */
 	for (int fd = 2; fd < FILED_MAX; fd++) {
 		if (curr->fdt[fd] != NULL) {
-			// lock_acquire(&filesys_lock);
 			file_close(curr->fdt[fd]);
-			// lock_release(&filesys_lock);
 			curr->fdt[fd] = NULL;
 		}
 	}
 	if (curr->running_file != NULL) {
-		// lock_acquire(&filesys_lock);
 		file_close(curr->running_file);
-		// lock_release(&filesys_lock);
 	}
+	dir_close(curr->cwd);
+	curr->cwd = NULL;
 
 	if (curr->child_info != NULL) {
 		curr->child_info->exit_status = curr->exit_status;
@@ -491,7 +495,6 @@ load (const char *file_name, struct intr_frame *if_) {
 	process_activate (thread_current ());
 
 	/* Open executable file. */
-	lock_acquire(&filesys_lock);
 	file = filesys_open (file_name);
 	if (file == NULL) {
 		printf ("load: %s: open failed\n", file_name);
@@ -580,7 +583,6 @@ load (const char *file_name, struct intr_frame *if_) {
 done:
 	/* We arrive here whether the load is successful or not. */
 	// file_close (file);
-	lock_release(&filesys_lock);
 	return success;
 }
 
@@ -732,28 +734,6 @@ install_page (void *upage, void *kpage, bool writable) {
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
-bool
-lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file
-	 * TODO: This called when the first page fault occurs on address VA.
-	 * TODO: VA is available when calling this function. */
-	struct lazy_load_args *lla = (struct lazy_load_args *) aux;
-	/* READ_BYTES bytes at UPAGE must be read from FILE starting at offset OFS. */
-	off_t segment = file_read_at(lla->file, page->frame->kva, lla->read_bytes, lla->ofs);
-	if (segment != lla->read_bytes)
-		return false;
-	/* ZERO_BYTES bytes at UPAGE + READ_BYTES must be zeroed. */
-	memset(page->frame->kva + lla->read_bytes, 0, lla->zero_bytes);
-
-	if (page_get_type(page) == VM_FILE) {
-		page->file.file = lla->file;
-		page->file.ofs = lla->ofs;
-		page->file.read_bytes= lla->read_bytes;
-		page->file.zero_bytes = lla->zero_bytes;
-	}
-	return true;
-}
-
 /* Loads a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
@@ -774,32 +754,10 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage, uint32_t read_bytes,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		struct lazy_load_args *aux = (struct lazy_load_args *)malloc(sizeof(struct lazy_load_args));
-		if (aux == NULL)
-			return false;
-		aux->file = file;
-		aux->ofs = ofs;
-		aux->read_bytes = page_read_bytes;
-		aux->zero_bytes = page_zero_bytes;
-		
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage, writable, lazy_load_segment, aux))
-			return false;
-
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
-		ofs += page_read_bytes;
-	}
-	return true;
+	/* Record the segment as one area; its pages are read in on first
+	 * fault by the area's initializer. */
+	return vma_insert (&thread_current ()->spt, upage, read_bytes + zero_bytes,
+			VM_ANON, writable, file, ofs, read_bytes) != NULL;
 }
 
 /* Create a PAGE of stack at the USER_STACK. Return true on success. */
@@ -811,8 +769,11 @@ setup_stack (struct intr_frame *if_) {
 	/* TODO: Map the stack on stack_bottom and claim the page immediately.
 	 * TODO: If success, set the rsp accordingly.
 	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
-	if(vm_alloc_page_with_initializer(VM_ANON | VM_MARKER_0, stack_bottom, true, NULL, NULL)) {
+	/* The whole range the stack may grow into is reserved as one area;
+	 * its pages are created as faults reach them. */
+	struct vma *vma = vma_insert(&thread_current()->spt, (void *) STACK_LIMIT,
+			USER_STACK - STACK_LIMIT, VM_ANON | VM_MARKER_0, true, NULL, 0, 0);
+	if (vma != NULL && vma_populate(vma, stack_bottom) != NULL) {
 		success = vm_claim_page(stack_bottom);
 		if (success) {
 			if_->rsp = USER_STACK;
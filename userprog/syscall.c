@@ -8,11 +8,14 @@
 #include "userprog/gdt.h"
 #include "threads/flags.h"
 #include "intrinsic.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
 #ifdef VM
+#include <mman.h>
 #include "vm/vm.h"
 #endif
 
@@ -20,6 +23,7 @@ void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
 bool check_address (const void *addr);
 bool check_buffer (void *buffer, size_t size, bool writable);
+static bool fd_is_dir (int fd);
 
 /* System call.
  *
@@ -45,13 +49,17 @@ syscall_init (void) {
 	 * mode stack. Therefore, we masked the FLAG_FL. */
 	write_msr(MSR_SYSCALL_MASK,
 			FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
-	// lock_init(&filesys_lock);
 }
 
 /* The main system call interface */
 void
 syscall_handler (struct intr_frame *f UNUSED) {
     thread_current()->stack_pointer = f->rsp;
+#ifdef VM
+	if (thread_current()->spt.oom_killed)
+		exit(-1);
+	vm_sample_working_set();
+#endif
 	switch(f->R.rax) {
 		case SYS_HALT:                   /* Halt the operating system. */
 			halt();
@@ -95,17 +103,56 @@ syscall_handler (struct intr_frame *f UNUSED) {
 		case SYS_CLOSE:                  /* Close a file. */
 			close(f->R.rdi);
 			break;
+		case SYS_CHDIR:                  /* Change the current directory. */
+			f->R.rax = chdir((const char *) f->R.rdi);
+			break;
+		case SYS_MKDIR:                  /* Create a directory. */
+			f->R.rax = mkdir((const char *) f->R.rdi);
+			break;
+		case SYS_READDIR:                /* Reads a directory entry. */
+			f->R.rax = readdir(f->R.rdi, (char *) f->R.rsi);
+			break;
+		case SYS_ISDIR:                  /* Tests if a fd represents a directory. */
+			f->R.rax = isdir(f->R.rdi);
+			break;
+		case SYS_INUMBER:                /* Returns the inode number for a fd. */
+			f->R.rax = inumber(f->R.rdi);
+			break;
+		case SYS_SYMLINK:                /* Creates a symbolic link. */
+			f->R.rax = symlink((const char *) f->R.rdi, (const char *) f->R.rsi);
+			break;
 #ifdef VM
 		case SYS_MMAP:					 /* Map a file into memory. */
 			f->R.rax = mmap(f->R.rdi, f->R.rsi, f->R.rdx, f->R.r10, f->R.r8);
 			break;
+		case SYS_MMAP_ANON:				 /* Map memory not backed by a file. */
+			f->R.rax = mmap_anon((void *) f->R.rdi, f->R.rsi, f->R.rdx, f->R.r10);
+			break;
 		case SYS_MUNMAP:				 /* Remove a memory mapping. */
 			munmap(f->R.rdi);
 			break;
+		case SYS_VMSTAT:				 /* Report paging statistics. */
+			f->R.rax = vmstat((struct vmstat *) f->R.rdi);
+			break;
+		case SYS_MADVISE:				 /* Give paging advice for a range. */
+			f->R.rax = madvise((void *) f->R.rdi, f->R.rsi, f->R.rdx);
+			break;
+		case SYS_MSYNC:					 /* Write back a file mapping. */
+			f->R.rax = msync((void *) f->R.rdi, f->R.rsi);
+			break;
+		case SYS_MEMPRESSURE:			 /* Report the memory pressure level. */
+			f->R.rax = mempressure();
+			break;
 #endif
 		default:
 			exit(f->R.rdi);
 	}
+#ifdef VM
+	/* An allocation that the OOM killer failed during the call ends the
+	 * process here, where it holds no locks. */
+	if (thread_current()->spt.oom_killed)
+		exit(-1);
+#endif
 }
 
 /* Shutdown pintos. */
@@ -147,28 +194,22 @@ int wait (pid_t pid) {
 /* Create file which have size of initial_size. */
 bool create (const char *file, unsigned initial_size) {
 	if (!check_address(file)) exit(-1);
-	lock_acquire(&filesys_lock);
 	bool res = filesys_create(file, initial_size);
-	lock_release(&filesys_lock);
 	return res;
 }
 
 /* Remove file whose name is file. */
 bool remove (const char *file) {
 	if (!check_address(file)) exit(-1);
-	lock_acquire(&filesys_lock);
 	bool res = filesys_remove(file);
-	lock_release(&filesys_lock);
 	return res;
 }
 
 /* Open the file corresponds to path in "file". */
 int open (const char *filename) {
 	if (!check_address(filename)) exit(-1);
-	lock_acquire(&filesys_lock);
 	struct file *file = filesys_open(filename);
-	// lock_release(&filesys_lock);
-	if (file == NULL) goto err; // Return -1 if file is not opened
+	if (file == NULL) return -1; // Return -1 if file is not opened
 
 	int fd;
 	bool is_not_full = false;
@@ -181,10 +222,9 @@ int open (const char *filename) {
 	if (!is_not_full) goto err; // Return -1 if fdt is full
 
 	thread_current()->fdt[fd] = file;
-	lock_release(&filesys_lock);
 	return fd;
 err:
-	lock_release(&filesys_lock);
+	file_close(file);
 	return -1;
 }
 
@@ -216,9 +256,8 @@ int read (int fd, void *buffer, unsigned size) {
 	else {
 		struct file *file = thread_current()->fdt[fd];
 		if (file == NULL) exit(-1);
-		lock_acquire(&filesys_lock);
+		if (fd_is_dir(fd)) return -1;
 		off_t res = file_read(file, buffer, size);
-		lock_release(&filesys_lock);
 		return res;
 	}
 }
@@ -239,9 +278,8 @@ int write(int fd, const void *buffer, unsigned size) {
 		struct file *file = curr->fdt[fd];
 		if (file == NULL) exit(-1);
 		if (curr->running_file == file) return 0;
-		lock_acquire(&filesys_lock);
+		if (fd_is_dir(fd)) return -1;
 		off_t res = file_write(file, buffer, size);
-		lock_release(&filesys_lock);
 		if (res < 0) return -1;
 		return res;
 	}
@@ -276,18 +314,86 @@ void close (int fd) {
 	// if (fd == curr->next_fd && curr->next_fd > 2) curr->next_fd--;
 	if (curr->running_file == file)
 		curr->running_file = NULL;
-	lock_acquire(&filesys_lock);
 	file_close(file);
-	lock_release(&filesys_lock);
+}
+
+/* Change the current working directory of the process to dir. */
+bool chdir (const char *dir) {
+	if (!check_address(dir)) exit(-1);
+	bool res = filesys_chdir(dir);
+	return res;
+}
+
+/* Create the directory named dir. */
+bool mkdir (const char *dir) {
+	if (!check_address(dir)) exit(-1);
+	bool res = filesys_mkdir(dir);
+	return res;
+}
+
+/* Read the next entry of the directory open as fd into name. */
+bool readdir (int fd, char *name) {
+	if (!check_address(name)) exit(-1);
+	if (!fd_is_dir(fd)) return false;
+	struct file *file = thread_current()->fdt[fd];
+	struct dir *dir = dir_open(inode_reopen(file_get_inode(file)));
+	bool res = false;
+	if (dir != NULL) {
+		dir_seek(dir, file_tell(file));
+		res = dir_readdir(dir, name);
+		file_seek(file, dir_tell(dir));
+		dir_close(dir);
+	}
+	return res;
+}
+
+/* Return true if fd represents a directory. */
+bool isdir (int fd) {
+	return fd_is_dir(fd);
+}
+
+/* Return the inode number of the file or directory open as fd. */
+int inumber (int fd) {
+	if (fd < 2 || fd >= FILED_MAX) exit(-1); // invalid fd
+	struct file *file = thread_current()->fdt[fd];
+	if (file == NULL) exit(-1);
+	return inode_get_inumber(file_get_inode(file));
+}
+
+/* Create a symbolic link linkpath that refers to target.
+ * Return 0 on success, -1 otherwise. */
+int symlink (const char *target, const char *linkpath) {
+	if (!check_address(target) || !check_address(linkpath)) exit(-1);
+	bool res = filesys_symlink(target, linkpath);
+	return res ? 0 : -1;
+}
+
+/* Return true if fd is open on a directory. */
+static bool fd_is_dir (int fd) {
+	if (fd < 2 || fd >= FILED_MAX) exit(-1); // invalid fd
+	struct file *file = thread_current()->fdt[fd];
+	if (file == NULL) exit(-1);
+	return inode_get_type(file_get_inode(file)) == INODE_DIR;
 }
 
 #ifdef VM
 
-/* Load file data into memory. */
+/* Return true if [addr, addr + length) can hold a new mapping. */
+static bool mmap_range_ok (void *addr, size_t length) {
+	if (length <= 0 || pg_round_down(addr) != addr || addr == 0)
+		return false;
+	return is_user_vaddr(addr) && is_user_vaddr(addr + length)
+		&& spt_find_page(&thread_current()->spt, addr) == NULL;
+}
+
+/* Load file data into memory.  With fd MAP_ANON_FD the mapping holds
+ * zeros instead, private to the process. */
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
-	if (length <= 0 || pg_round_down(addr) != addr || pg_round_down(offset) != offset || addr == 0 || fd == 0 || fd == 1)
+	if (!mmap_range_ok(addr, length) || pg_round_down(offset) != offset || fd == 0 || fd == 1)
 		return NULL;
-	if (!is_user_vaddr(addr) || !is_user_vaddr(addr + length) || spt_find_page(&thread_current()->spt, addr) != NULL)
+	if (fd == MAP_ANON_FD)
+		return do_mmap_anon(addr, length, writable, false);
+	if (fd < 0)
 		return NULL;
 	struct file *file = thread_current()->fdt[fd];
 	if (file == NULL) return NULL;
@@ -295,6 +401,14 @@ void *mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
 	return do_mmap(addr, length, writable, file, offset);
 }
 
+/* Map length bytes of zeros at addr, shared with children forked
+ * later if flags has MAP_SHARED and private otherwise. */
+void *mmap_anon (void *addr, size_t length, int writable, int flags) {
+	if (!mmap_range_ok(addr, length) || (flags & ~MAP_SHARED) != 0)
+		return NULL;
+	return do_mmap_anon(addr, length, writable, flags & MAP_SHARED);
+}
+
 /* Unmap the mappings which has not been previously unmapped. */
 void munmap (void *addr) {
 	if (pg_round_down(addr) != addr || addr == 0)
@@ -302,6 +416,32 @@ void munmap (void *addr) {
 	do_munmap(addr);
 }
 
+/* Copy the paging statistics of the current process into stat. */
+bool vmstat (struct vmstat *stat) {
+	if (!check_address(stat) || !check_buffer(stat, sizeof *stat, true))
+		exit(-1);
+	vm_get_stats(stat);
+	return true;
+}
+
+/* Advise the kernel how the pages in [addr, addr + length) will be used.
+ * Returns 0 on success, -1 if the range is not mapped or advice is bad. */
+int madvise (void *addr, size_t length, int advice) {
+	return vm_madvise(addr, length, advice) ? 0 : -1;
+}
+
+/* Write the dirty pages of the file mappings in [addr, addr + length)
+ * back to their files.  Returns 0 on success, -1 if the range is not
+ * mapped. */
+int msync (void *addr, size_t length) {
+	return do_msync(addr, length) ? 0 : -1;
+}
+
+/* Report the memory pressure level, one of VM_PRESSURE_*. */
+int mempressure (void) {
+	return vm_pressure();
+}
+
 #endif
 
 bool check_address(const void *addr) {
@@ -310,18 +450,34 @@ bool check_address(const void *addr) {
 #ifndef VM
 	void *page = pml4_get_page(thread_current()->pml4, addr);
 #else
-	struct page *page = spt_find_page(&thread_current()->spt, addr);
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	void *page = spt_find_page(spt, addr);
+	if (page == NULL)
+		page = vma_find(spt, addr);  /* Mapped, but not faulted in yet. */
 #endif
 	if (page == NULL)
 		return false;
 	return true;
 }
 
+#ifdef VM
 bool check_buffer(void *buffer, size_t size, bool writable) {
+	struct supplemental_page_table *spt = &thread_current()->spt;
     for (size_t i = 0; i < size; i += 8) {
-        struct page *page = spt_find_page(&thread_current()->spt, buffer + i);
-        if (page == NULL || (writable && !page->writable))
+        struct page *page = spt_find_page(spt, buffer + i);
+		if (page == NULL) {
+			struct vma *vma = vma_find(spt, buffer + i);
+			if (vma == NULL || (writable && !vma->writable))
+				return false;
+			continue;
+		}
+        if (writable && !page->writable)
             return false;
+		/* The kernel writes through the user mapping, so a page still
+		 * sharing the zero frame needs its own frame first. */
+		if (writable && !vm_page_make_private(page))
+			return false;
     }
 	return true;
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
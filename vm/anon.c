@@ -2,7 +2,9 @@
 
 #include "vm/vm.h"
 #include "threads/vaddr.h"
+#include "threads/mmu.h"
 #include "devices/disk.h"
+#include "vm/zswap.h"
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -14,6 +16,11 @@ static size_t get_free_swap_slot (void);
 #define SWAP_SLOTS_CNT (PGSIZE / DISK_SECTOR_SIZE)
 struct bitmap *swap_slot;
 static struct lock swap_lock;
+static void *swap_buf;      /* Bounce page for zswap writeback. */
+
+static void swap_read (size_t slot_idx, void *kva);
+static void swap_write (size_t slot_idx, const void *kva);
+static bool anon_writeback_coldest (void);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations anon_ops = {
@@ -32,6 +39,9 @@ vm_anon_init (void) {
 	swap_slot = bitmap_create(swap_slot_cnt);
 	lock_init(&swap_lock);
 	ASSERT(swap_slot != NULL);
+	zswap_init();
+	if (zswap_budget > 0)
+		swap_buf = palloc_get_page(PAL_ASSERT);
 }
 
 /* Initialize the file mapping */
@@ -42,59 +52,136 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 
 	struct anon_page *anon_page = &page->anon;
 	anon_page->slot_idx = BITMAP_ERROR;
+	anon_page->zentry = NULL;
 	return true;
 }
 
-/* Swap in the page by read contents from the swap disk. */
+/* Stores the number of free swap slots in *FREE_CNT and the size of
+ * the swap disk, in slots, in *TOTAL_CNT. */
+void
+vm_anon_swap_stats (size_t *free_cnt, size_t *total_cnt) {
+	lock_acquire (&swap_lock);
+	*total_cnt = bitmap_size (swap_slot);
+	*free_cnt = bitmap_count (swap_slot, 0, *total_cnt, false);
+	lock_release (&swap_lock);
+}
+
+/* Map LENGTH bytes of zeros at ADDR, private to the current process or,
+ * if SHARED, shared with the children it forks afterwards. */
+void *
+do_mmap_anon (void *addr, size_t length, bool writable, bool shared) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *vma = vma_insert (spt, addr, length, VM_ANON, writable,
+			NULL, 0, 0);
+
+	if (vma == NULL)
+		return NULL;
+	vma->mapped = true;
+	if (shared) {
+		vma->shm = shm_create ((vma->end - vma->start) / PGSIZE);
+		if (vma->shm == NULL) {
+			vma_remove (spt, vma);
+			return NULL;
+		}
+	}
+	return addr;
+}
+
+/* Swap in the page by read contents from the compressed tier or the swap
+ * disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
 	size_t slot_idx = anon_page->slot_idx;
-	if (slot_idx == BITMAP_ERROR) {
+	lock_acquire(&swap_lock);
+	if (anon_page->zentry != NULL || slot_idx != BITMAP_ERROR)
+		thread_current ()->spt.swapped--;
+	if (anon_page->zentry != NULL) {
+		zswap_load(anon_page->zentry, kva);
+		zswap_free(anon_page->zentry);
+		anon_page->zentry = NULL;
+	} else if (slot_idx == BITMAP_ERROR) {
 		// 새로 만든 스택 페이지: swap에서 불러올 게 없음
-        memset(kva, 0, PGSIZE);
-        return true;
+		memset(kva, 0, PGSIZE);
+	} else {
+		swap_read(slot_idx, kva);
+		bitmap_reset(swap_slot, slot_idx);
+		anon_page->slot_idx = BITMAP_ERROR;
 	}
-	lock_acquire(&swap_lock);
-    for (int i = 0; i < SWAP_SLOTS_CNT; i++) {
-        disk_read(swap_disk, slot_idx * SWAP_SLOTS_CNT + i, kva + i * DISK_SECTOR_SIZE);
-    }
-    bitmap_reset(swap_slot, slot_idx);
-	anon_page->slot_idx = BITMAP_ERROR;
 	lock_release(&swap_lock);
-    return true;
+	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Swap out the page by keeping it compressed in memory, or by writing its
+ * contents to the swap disk.  The caller unmaps it. */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+	bool success = true;
 	lock_acquire(&swap_lock);
-	size_t slot_idx = bitmap_scan(swap_slot, 0, 1, false);
-	if (slot_idx == BITMAP_ERROR) {
-		lock_release(&swap_lock);
-		return false;
+	anon_page->zentry = zswap_store(page, page->frame->kva);
+	if (anon_page->zentry == NULL) {
+		size_t slot_idx = bitmap_scan_and_flip(swap_slot, 0, 1, false);
+		if (slot_idx != BITMAP_ERROR) {
+			anon_page->slot_idx = slot_idx;
+			swap_write(slot_idx, page->frame->kva);
+		} else
+			success = false;
 	}
-	bitmap_mark(swap_slot, slot_idx);
+	if (success)
+		page->frame->owner->spt.swapped++;
+	while (zswap_over_budget() && anon_writeback_coldest())
+		continue;
 	lock_release(&swap_lock);
-    anon_page->slot_idx = slot_idx;
-    for (int i = 0; i < SWAP_SLOTS_CNT; i++) {
-        disk_write(swap_disk, slot_idx * SWAP_SLOTS_CNT + i, page->frame->kva + i * DISK_SECTOR_SIZE);
-    }
-	pml4_clear_page(thread_current()->pml4, page->va);
-	list_remove(&page->frame->frame_elem);
-    page->frame = NULL;
-    return true;
+	return success;
 }
 
-/* Destroy the anonymous page. PAGE will be freed by the caller. */
+/* Move the coldest page of the compressed tier to the swap disk.  Returns
+ * false if the swap disk is full. */
+static bool
+anon_writeback_coldest (void) {
+	size_t slot_idx = bitmap_scan_and_flip(swap_slot, 0, 1, false);
+	if (slot_idx == BITMAP_ERROR)
+		return false;
+	struct page *page = zswap_evict(swap_buf);
+	page->anon.zentry = NULL;
+	page->anon.slot_idx = slot_idx;
+	swap_write(slot_idx, swap_buf);
+	return true;
+}
+
+/* Read swap slot SLOT_IDX into the page at KVA. */
+static void
+swap_read (size_t slot_idx, void *kva) {
+	for (int i = 0; i < SWAP_SLOTS_CNT; i++)
+		disk_read(swap_disk, slot_idx * SWAP_SLOTS_CNT + i, kva + i * DISK_SECTOR_SIZE);
+}
+
+/* Write the page at KVA to swap slot SLOT_IDX. */
+static void
+swap_write (size_t slot_idx, const void *kva) {
+	for (int i = 0; i < SWAP_SLOTS_CNT; i++)
+		disk_write(swap_disk, slot_idx * SWAP_SLOTS_CNT + i, kva + i * DISK_SECTOR_SIZE);
+}
+
+/* Destroy the anonymous page. PAGE will be freed by the caller, which also
+ * unmaps it, together with its neighbours, through pml4_clear_range (). */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
-	if (anon_page->slot_idx != BITMAP_ERROR) {
+	if (anon_page->zentry != NULL || anon_page->slot_idx != BITMAP_ERROR) {
 		lock_acquire(&swap_lock);
-		bitmap_reset(swap_slot, anon_page->slot_idx);
+		thread_current ()->spt.swapped--;
+		if (anon_page->zentry != NULL)
+			zswap_free(anon_page->zentry);
+		else
+			bitmap_reset(swap_slot, anon_page->slot_idx);
 		lock_release(&swap_lock);
+		anon_page->zentry = NULL;
 		anon_page->slot_idx = BITMAP_ERROR;
 	}
+	if (page->frame != NULL) {
+		vm_free_frame(page->frame);
+		page->frame = NULL;
+	}
 }
@@ -1,12 +1,39 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
 #include "vm/vm.h"
+#include <stdio.h>
 #include "userprog/process.h"
 #include "threads/vaddr.h"
 #include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
 #include "filesys/filesys.h"
 
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+
+/* Most pages gathered into one file_write_at () by file_sync_area (). */
+#define SYNC_RUN_PAGES 16
+
+/* Ticks between two passes of the writeback thread. */
+#define SYNC_TICKS (5 * TIMER_FREQ)
+
+static size_t sync_pages;          /* # of dirty pages written back. */
+static size_t sync_writes;         /* # of file_write_at () calls for them. */
+
+/* Held from the moment a dirty file page is copied or checked until it
+ * is written, so that writebacks of one page reach the file in the
+ * order they were taken, and while a resident file page is destroyed,
+ * so that the file of a mapping stays open until the writeback thread
+ * has written what it copied. */
+static struct lock writeback_lock;
+
+extern struct list frame_table;
+
+static void file_syncd (void *aux);
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
@@ -23,6 +50,8 @@ static const struct page_operations file_ops = {
 /* The initializer of file vm */
 void
 vm_file_init (void) {
+	lock_init (&writeback_lock);
+	thread_create ("mmap_syncd", PRI_DEFAULT, file_syncd, NULL);
 }
 
 /* Initialize the file backed page */
@@ -39,16 +68,13 @@ file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
 	struct file_page *file_page UNUSED = &page->file;
-	// lock_acquire(&filesys_lock);
 	struct file *file = file_page->file;
     off_t ofs = file_page->ofs;
     size_t read_bytes = file_page->read_bytes;
     size_t zero_bytes = file_page->zero_bytes;
     if (file_read_at(file, kva, read_bytes, ofs) != read_bytes) {
-		lock_release(&filesys_lock);
 		return false;
 	}
-	// lock_release(&filesys_lock);
     memset(kva + read_bytes, 0, zero_bytes);
     return true;
 }
@@ -57,16 +83,17 @@ file_backed_swap_in (struct page *page, void *kva) {
 static bool
 file_backed_swap_out (struct page *page) {
 	struct file_page *file_page UNUSED = &page->file;
+	uint64_t *pml4 = page->frame->owner->pml4;
 
-	if (pml4_is_dirty(thread_current()->pml4,page->va)){
-		// lock_acquire(&filesys_lock);
+	lock_acquire (&writeback_lock);
+	if (pml4_is_dirty(pml4, page->va)){
 		file_write_at(file_page->file, page->frame->kva, file_page->read_bytes, file_page->ofs);
-		pml4_set_dirty(thread_current()->pml4, page->va, false);
-		// lock_release(&filesys_lock);
+		pml4_set_dirty(pml4, page->va, false);
 	}
+	lock_release (&writeback_lock);
 	page->frame->page = NULL;
     page->frame = NULL;
-	pml4_clear_page(thread_current()->pml4, page->va);
+	pml4_clear_page(pml4, page->va);
 	// list_remove(&page->frame->frame_elem);
 	// // palloc_free_page(page->frame->kva);
 	// // free(page->frame);
@@ -74,88 +101,250 @@ file_backed_swap_out (struct page *page) {
 	return true;
 }
 
-/* Destory the file backed page. PAGE will be freed by the caller. */
+/* Destory the file backed page. PAGE will be freed by the caller, which
+ * also unmaps it through pml4_clear_range (). */
 static void
 file_backed_destroy (struct page *page) {
 	struct file_page *file_page UNUSED = &page->file;
-	if (file_page->file == NULL)
+	if (file_page->file == NULL || page->frame == NULL)
 		return;
+	lock_acquire (&writeback_lock);
     if (pml4_is_dirty(thread_current()->pml4, page->va)) {
         file_write_at(file_page->file, page->frame->kva, file_page->read_bytes, file_page->ofs);
         pml4_set_dirty(thread_current()->pml4, page->va, false);
     }
-    pml4_clear_page(thread_current()->pml4, page->va);
-	if (page->frame != NULL) {
-		list_remove(&page->frame->frame_elem);
-		palloc_free_page(page->frame->kva);
-		free(page->frame);
-		page->frame = NULL;
+	vm_free_frame(page->frame);
+	page->frame = NULL;
+	lock_release (&writeback_lock);
+}
+
+/* Pages gathered for one write by file_sync_area (). */
+struct sync_run {
+	uint8_t *buf;               /* SYNC_RUN_PAGES pages, or NULL. */
+	bool buf_tried;             /* BUF was asked for already. */
+	struct file *file;
+	off_t ofs;                  /* File offset of the first byte. */
+	size_t len;                 /* Bytes gathered so far. */
+};
+
+static void
+sync_run_flush (struct sync_run *run) {
+	if (run->len > 0) {
+		file_write_at (run->file, run->buf, run->len, run->ofs);
+		sync_writes++;
+		run->len = 0;
 	}
 }
 
+/* Write back the dirty resident pages of VMA, a file mapping of the
+ * current process, that lie in [START, END).  Consecutive dirty pages
+ * are gathered into RUN and written with a single call.  The dirty bit
+ * is cleared before a page is copied, so a later store dirties it
+ * again. */
+static void
+file_sync_area (struct vma *vma, void *start, void *end,
+		struct sync_run *run) {
+	struct thread *t = thread_current ();
+	void *va;
+
+	run->file = vma->file;
+	for (va = MAX (start, vma->start); va < MIN (end, vma->end); va += PGSIZE) {
+		struct page *page = spt_find_page (&t->spt, va);
+		struct file_page *file_page;
+
+		if (page == NULL || page->frame == NULL
+				|| page->operations->type != VM_FILE
+				|| !pml4_is_dirty (t->pml4, va)) {
+			sync_run_flush (run);
+			continue;
+		}
+		file_page = &page->file;
+		pml4_set_dirty (t->pml4, va, false);
+		sync_pages++;
+
+		/* The buffer is taken only once a dirty page shows up, and
+		 * without it each page is written on its own. */
+		if (run->buf == NULL && !run->buf_tried) {
+			run->buf = palloc_get_multiple (0, SYNC_RUN_PAGES);
+			run->buf_tried = true;
+		}
+
+		if (run->buf == NULL) {
+			file_write_at (file_page->file, page->frame->kva,
+					file_page->read_bytes, file_page->ofs);
+			sync_writes++;
+			continue;
+		}
+		if (run->len == 0)
+			run->ofs = file_page->ofs;
+		memcpy (run->buf + run->len, page->frame->kva, file_page->read_bytes);
+		run->len += file_page->read_bytes;
+		/* A page cut short by the end of file ends the run. */
+		if (file_page->read_bytes < PGSIZE
+				|| run->len == SYNC_RUN_PAGES * PGSIZE)
+			sync_run_flush (run);
+	}
+	sync_run_flush (run);
+}
+
+/* Write back the dirty pages of the file mappings of the current process
+ * in [START, END).  Costs no memory unless some page is dirty. */
+static void
+file_sync_range (void *start, void *end) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct sync_run run = { .buf = NULL, .buf_tried = false, .len = 0 };
+	struct list_elem *e;
+
+	lock_acquire (&writeback_lock);
+	for (e = list_begin (&spt->vmas); e != list_end (&spt->vmas);
+			e = list_next (e)) {
+		struct vma *vma = list_entry (e, struct vma, elem);
+		if (vma->start >= end)
+			break;
+		if (start < vma->end && VM_TYPE (vma->type) == VM_FILE && vma->writable)
+			file_sync_area (vma, start, end, &run);
+	}
+	lock_release (&writeback_lock);
+	if (run.buf != NULL)
+		palloc_free_multiple (run.buf, SYNC_RUN_PAGES);
+}
+
+/* Write back the dirty pages of the current process's file mappings in
+ * the LENGTH bytes at ADDR, then sync the file system so that they reach
+ * the disk.  ADDR must be page aligned and the whole range mapped.  The
+ * pages stay mapped. */
+bool
+do_msync (void *addr, size_t length) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *vma;
+	void *end, *va;
+
+	if (addr == NULL || pg_ofs (addr) != 0 || !is_user_vaddr (addr)
+			|| length == 0 || length > (size_t) (KERN_BASE - (uint64_t) addr))
+		return false;
+	end = pg_round_up (addr + length);
+	for (va = addr; va < end; va = vma->end)
+		if ((vma = vma_find (spt, va)) == NULL)
+			return false;
+
+	file_sync_range (addr, end);
+	filesys_sync ();
+	return true;
+}
+
+/* Write back every dirty file page of the current process. */
+void
+file_sync_all (void) {
+	file_sync_range (NULL, (void *) KERN_BASE);
+}
+
+/* A page copied out by file_sync_frames (). */
+struct sync_copy {
+	struct file *file;
+	off_t ofs;
+	size_t len;
+};
+
+/* Copy up to SYNC_RUN_PAGES dirty file pages of any process into BUF,
+ * clearing their dirty bits, and describe them in COPIES.  Interrupts
+ * are off during the walk, so no frame goes away under it.  Returns
+ * the number of pages copied. */
+static size_t
+file_sync_collect (uint8_t *buf, struct sync_copy *copies) {
+	enum intr_level old_level = intr_disable ();
+	struct list_elem *e;
+	size_t cnt = 0;
+
+	for (e = list_begin (&frame_table);
+			e != list_end (&frame_table) && cnt < SYNC_RUN_PAGES;
+			e = list_next (e)) {
+		struct frame *frame = list_entry (e, struct frame, frame_elem);
+		struct page *page = frame->page;
+		uint64_t *pml4 = frame->owner != NULL ? frame->owner->pml4 : NULL;
+
+		if (page == NULL || pml4 == NULL || frame->share != NULL
+				|| page->operations->type != VM_FILE
+				|| page->file.file == NULL || !pml4_is_dirty (pml4, page->va))
+			continue;
+		pml4_set_dirty (pml4, page->va, false);
+		memcpy (buf + cnt * PGSIZE, frame->kva, page->file.read_bytes);
+		copies[cnt].file = page->file.file;
+		copies[cnt].ofs = page->file.ofs;
+		copies[cnt].len = page->file.read_bytes;
+		cnt++;
+	}
+	intr_set_level (old_level);
+	return cnt;
+}
+
+/* Write back the dirty file pages of every process, a batch at a time.
+ * Holding writeback_lock keeps each copied page's file open and its
+ * owner from writing a newer copy first. */
+static void
+file_sync_frames (void) {
+	struct sync_copy copies[SYNC_RUN_PAGES];
+	uint8_t *buf = palloc_get_multiple (0, SYNC_RUN_PAGES);
+	size_t cnt, i;
+
+	if (buf == NULL)
+		return;
+	lock_acquire (&writeback_lock);
+	do {
+		cnt = file_sync_collect (buf, copies);
+		for (i = 0; i < cnt; i++)
+			file_write_at (copies[i].file, buf + i * PGSIZE, copies[i].len,
+					copies[i].ofs);
+		sync_pages += cnt;
+		sync_writes += cnt;
+	} while (cnt == SYNC_RUN_PAGES);
+	lock_release (&writeback_lock);
+	palloc_free_multiple (buf, SYNC_RUN_PAGES);
+}
+
+/* Writeback thread: every SYNC_TICKS writes back the dirty pages of
+ * all file mappings, bounding how much a crash can lose no matter
+ * whether their processes make system calls. */
+static void
+file_syncd (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (SYNC_TICKS);
+		file_sync_frames ();
+	}
+}
+
+/* Prints writeback statistics. */
+void
+vm_file_print_stats (void) {
+	printf ("Writeback: %zu dirty file pages in %zu writes\n",
+			sync_pages, sync_writes);
+}
+
 /* Do the mmap */
 void *
 do_mmap (void *addr, size_t length, int writable, struct file *file, off_t offset) {
-	lock_acquire(&filesys_lock);
-	struct file *file_ = file_reopen(file);
-	if (file_ == NULL) {
-		lock_release(&filesys_lock);
-		return NULL;
-	}
-	size_t read_bytes = MIN(length, file_length(file_) - offset);
-	size_t zero_bytes = pg_round_up(length) - read_bytes;
+	struct supplemental_page_table *spt = &thread_current ()->spt;
 
-	ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
 	ASSERT (pg_ofs (addr) == 0);
 	ASSERT (offset % PGSIZE == 0);
 
-	void *ret = addr;
-    while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-        size_t page_read_bytes = MIN(read_bytes, PGSIZE);
-        size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-        struct lazy_load_args *aux = (struct lazy_load_args *)malloc(sizeof(struct lazy_load_args));
-		if (aux == NULL) {
-			lock_release(&filesys_lock);
-			return NULL;
-		}
-        aux->file = file_;
-        aux->ofs = offset;
-        aux->read_bytes = page_read_bytes;
-        aux->zero_bytes = page_zero_bytes;
-
-        if (!vm_alloc_page_with_initializer(VM_FILE, addr, writable, lazy_load_segment, aux)) {
-			lock_release(&filesys_lock);
-			free(aux);
-			return NULL;
-		}
-
-        read_bytes -= page_read_bytes;
-        zero_bytes -= page_zero_bytes;
-        addr += PGSIZE;
-        offset += page_read_bytes;
-    }
-	lock_release(&filesys_lock);
-    return ret;
+	/* Only the area is recorded here; pages are created on first fault. */
+	off_t file_len = file_length(file);
+	size_t read_bytes = offset < file_len ? MIN(length, (size_t) (file_len - offset)) : 0;
+	struct vma *vma = vma_insert(spt, addr, length, VM_FILE, writable, file, offset, read_bytes);
+	if (vma == NULL)
+		return NULL;
+	vma->mapped = true;
+	return addr;
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
-	/* TODO: Remove mmaped page from mmap list of current thread */
-	struct thread *curr = thread_current();
-	struct page *page;
-	lock_acquire(&filesys_lock);
-    while ((page = spt_find_page(&curr->spt, addr))) {
-		destroy(page);
-		page->file.file = NULL;
-		// list_remove(&page->file.elem);
-		// list_remove(&page->frame->frame_elem);
-		spt_remove_page(&curr->spt, page);
-		addr += PGSIZE;
-	}
-	lock_release(&filesys_lock);
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *vma = vma_find(spt, addr);
+	if (vma == NULL || vma->start != addr || !vma->mapped)
+		return;
+	/* Write the dirty pages back in large runs before tearing down. */
+	file_sync_range(vma->start, vma->end);
+	vma_remove(spt, vma);
 }
@@ -0,0 +1,180 @@
+/* share.c: Sharing of read-only executable pages between processes.
+ *
+ * A page of a read-only, file backed area (the text of a program) is the
+ * same in every process that maps it, so its frame is kept in a table keyed
+ * by (inode, offset, bytes read) and mapped read-only by all of them.  The
+ * frame is reference counted, stays off the frame table so it is never
+ * evicted, and is freed when the last page mapping it is destroyed.
+ *
+ * The first fault on a page enters it in the table as loading and reads
+ * it without share_lock, so faults on other pages go on meanwhile;
+ * faults on the same page wait for the read on share_cond. */
+
+#include "vm/share.h"
+#include <hash.h>
+#include <stdio.h>
+#include "vm/vm.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+/* A shared frame. */
+struct share_entry {
+	struct inode *inode;        /* File the contents come from (owned). */
+	off_t ofs;                  /* Offset of the page in INODE. */
+	size_t read_bytes;          /* Bytes read, the rest is zero. */
+	struct frame *frame;        /* Frame holding the contents. */
+	int ref_cnt;                /* # of pages mapping FRAME. */
+	bool loading;               /* FRAME is still being read. */
+	struct hash_elem elem;      /* Element of share_table. */
+};
+
+static struct hash share_table;
+static struct lock share_lock;
+static struct condition share_cond;   /* Signaled when a read is done. */
+
+static size_t share_loads;      /* # of shared frames read from a file. */
+static size_t share_hits;       /* # of faults served by an existing one. */
+
+static uint64_t
+share_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct share_entry *s = hash_entry (e, struct share_entry, elem);
+	return hash_bytes (&s->inode, sizeof s->inode) ^ hash_int (s->ofs);
+}
+
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct share_entry *a = hash_entry (a_, struct share_entry, elem);
+	const struct share_entry *b = hash_entry (b_, struct share_entry, elem);
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	if (a->ofs != b->ofs)
+		return a->ofs < b->ofs;
+	return a->read_bytes < b->read_bytes;
+}
+
+/* Initialize the table of shared frames. */
+void
+vm_share_init (void) {
+	hash_init (&share_table, share_hash, share_less, NULL);
+	lock_init (&share_lock);
+	cond_init (&share_cond);
+}
+
+/* Returns true if PAGE is a not yet loaded page of a read-only area whose
+ * contents come, at least in part, from a file. */
+bool
+vm_share_candidate (struct page *page) {
+	struct vma *vma = page->vma;
+
+	return page->operations->type == VM_UNINIT && vma != NULL
+		&& !vma->writable && vma->file != NULL
+		&& VM_TYPE (vma->type) == VM_ANON
+		&& (size_t) (page->va - vma->start) < vma->read_bytes;
+}
+
+/* Map the shared frame holding PAGE, a vm_share_candidate (), reading it
+ * from the file if no process has it yet.  If another process is reading
+ * it, wait for that read. */
+bool
+vm_share_claim (struct page *page) {
+	struct thread *t = thread_current ();
+	struct vma *vma = page->vma;
+	size_t page_ofs = page->va - vma->start;
+	struct share_entry key, *s;
+	struct hash_elem *e;
+	bool success = false;
+
+	key.inode = file_get_inode (vma->file);
+	key.ofs = vma->ofs + page_ofs;
+	key.read_bytes = MIN (vma->read_bytes - page_ofs, PGSIZE);
+
+	lock_acquire (&share_lock);
+	for (;;) {
+		e = hash_find (&share_table, &key.elem);
+		if (e == NULL)
+			break;
+		s = hash_entry (e, struct share_entry, elem);
+		if (!s->loading)
+			break;
+		/* A failed read removes the entry, so look it up again. */
+		cond_wait (&share_cond, &share_lock);
+	}
+	if (e != NULL) {
+		if (!page->uninit.page_initializer (page, page->uninit.type,
+					s->frame->kva))
+			goto done;
+		t->spt.stats.minor_faults++;
+		share_hits++;
+	} else {
+		s = malloc (sizeof *s);
+		if (s == NULL)
+			goto done;
+		*s = key;
+		s->ref_cnt = 0;
+		s->loading = true;
+		s->inode = inode_reopen (s->inode);
+		hash_insert (&share_table, &s->elem);
+		lock_release (&share_lock);
+
+		s->frame = vm_get_unevictable_frame ();
+		if (s->frame != NULL) {
+			s->frame->share = s;
+			page->frame = s->frame;
+			if (!swap_in (page, s->frame->kva)) {
+				page->frame = NULL;
+				palloc_free_page (s->frame->kva);
+				free (s->frame);
+				s->frame = NULL;
+			}
+		}
+
+		lock_acquire (&share_lock);
+		s->loading = false;
+		cond_broadcast (&share_cond, &share_lock);
+		if (s->frame == NULL) {
+			hash_delete (&share_table, &s->elem);
+			inode_close (s->inode);
+			free (s);
+			goto done;
+		}
+		t->spt.stats.major_faults++;
+		share_loads++;
+	}
+
+	page->frame = s->frame;
+	s->ref_cnt++;
+	success = pml4_set_page (t->pml4, page->va, s->frame->kva, false);
+done:
+	lock_release (&share_lock);
+	return success;
+}
+
+/* Drop one reference to the shared FRAME, freeing it with the last. */
+void
+vm_share_release (struct frame *frame) {
+	struct share_entry *s = frame->share;
+
+	lock_acquire (&share_lock);
+	if (--s->ref_cnt == 0) {
+		hash_delete (&share_table, &s->elem);
+		inode_close (s->inode);
+		palloc_free_page (frame->kva);
+		free (frame);
+		free (s);
+	}
+	lock_release (&share_lock);
+}
+
+/* Print sharing statistics. */
+void
+vm_share_print_stats (void) {
+	printf ("VM: %zu text pages loaded shared, %zu faults served from them\n",
+			share_loads, share_hits);
+}
@@ -0,0 +1,116 @@
+/* shm.c: Shared anonymous memory.
+ *
+ * mmap () with fd -1 and MAP_SHARED creates an area backed by a shm
+ * object instead of private pages.  The object owns one frame per page,
+ * allocated zeroed on the first fault and mapped by every area that
+ * refers to the object.  fork () gives the child's copy of the area a
+ * new reference, so parent and children see each other's stores.  The
+ * object is reference counted by areas, and frees its frames when the
+ * last one is removed; until then they stay off the frame table and are
+ * never evicted, since no reverse map tells which page tables map them. */
+
+#include "vm/shm.h"
+#include <stdio.h>
+#include "vm/vm.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A shared anonymous memory object. */
+struct shm {
+	int ref_cnt;                /* # of areas mapping the object. */
+	struct lock lock;           /* Guards REF_CNT and FRAMES. */
+	size_t page_cnt;
+	struct frame *frames[];     /* Frame of each page, NULL until touched. */
+};
+
+static size_t shm_frames;       /* # of frames currently held by objects. */
+
+/* Create an object of PAGE_CNT zero pages with one reference.  Returns
+ * NULL if memory runs out. */
+struct shm *
+shm_create (size_t page_cnt) {
+	struct shm *shm = calloc (1, sizeof *shm + page_cnt * sizeof *shm->frames);
+
+	if (shm == NULL)
+		return NULL;
+	shm->ref_cnt = 1;
+	lock_init (&shm->lock);
+	shm->page_cnt = page_cnt;
+	return shm;
+}
+
+/* Add a reference to SHM and return it.  SHM may be NULL. */
+struct shm *
+shm_reopen (struct shm *shm) {
+	if (shm != NULL) {
+		lock_acquire (&shm->lock);
+		shm->ref_cnt++;
+		lock_release (&shm->lock);
+	}
+	return shm;
+}
+
+/* Drop a reference to SHM, freeing it and its frames with the last.
+ * The pages mapping them must be unmapped already.  SHM may be NULL. */
+void
+shm_close (struct shm *shm) {
+	bool last;
+
+	if (shm == NULL)
+		return;
+	lock_acquire (&shm->lock);
+	last = --shm->ref_cnt == 0;
+	lock_release (&shm->lock);
+	if (!last)
+		return;
+
+	/* No one else refers to SHM any more. */
+	for (size_t i = 0; i < shm->page_cnt; i++)
+		if (shm->frames[i] != NULL) {
+			palloc_free_page (shm->frames[i]->kva);
+			free (shm->frames[i]);
+			shm_frames--;
+		}
+	free (shm);
+}
+
+/* Map the frame of the object behind PAGE, a fresh page of a shared
+ * area, allocating it on the first fault by any process. */
+bool
+shm_claim (struct page *page) {
+	struct vma *vma = page->vma;
+	struct shm *shm = vma->shm;
+	size_t idx = (page->va - vma->start) / PGSIZE;
+	struct frame *frame;
+
+	ASSERT (idx < shm->page_cnt);
+
+	lock_acquire (&shm->lock);
+	frame = shm->frames[idx];
+	if (frame == NULL) {
+		frame = vm_get_unevictable_frame ();
+		if (frame == NULL) {
+			lock_release (&shm->lock);
+			return false;
+		}
+		memset (frame->kva, 0, PGSIZE);
+		frame->shm = shm;
+		shm->frames[idx] = frame;
+		shm_frames++;
+	}
+	lock_release (&shm->lock);
+
+	if (!page->uninit.page_initializer (page, page->uninit.type, frame->kva))
+		return false;
+	page->frame = frame;
+	return pml4_set_page (thread_current ()->pml4, page->va, frame->kva,
+			vma->writable);
+}
+
+/* Print shared memory statistics. */
+void
+shm_print_stats (void) {
+	printf ("VM: %zu frames of shared anonymous memory\n", shm_frames);
+}
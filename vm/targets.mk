@@ -2,4 +2,8 @@ vm_SRC = vm/vm.c          # Main api proxy
 vm_SRC += vm/uninit.c     # Uninitialized page
 vm_SRC += vm/anon.c       # Anonymous page
 vm_SRC += vm/file.c       # File mapped page
+vm_SRC += vm/vma.c        # Virtual memory areas
+vm_SRC += vm/zswap.c      # Compressed swap tier
+vm_SRC += vm/share.c      # Shared text pages
+vm_SRC += vm/shm.c        # Shared anonymous memory
 vm_SRC += vm/inspect.c    # Testing utility
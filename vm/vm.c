@@ -1,16 +1,55 @@
 /* vm.c: Generic interface for virtual memory objects. */
 #include <hash.h>
+#include <round.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include "threads/malloc.h"
 #include "threads/mmu.h"
 #include "userprog/process.h"
+#include "userprog/syscall.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/zswap.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+#include "filesys/filesys.h"
 #include "list.h"
 
 struct list frame_table;
 struct list_elem *fte;
 
+/* Shared read-only frame of zeros.  Fresh anonymous pages that are only
+ * read are mapped to it instead of getting a private frame; the private
+ * frame is allocated on the first write fault. */
+struct frame zero_frame;
+size_t zero_page_maps;     /* # of pages ever mapped to the zero frame. */
+size_t zero_page_copies;   /* # of them upgraded to a private frame. */
+size_t large_page_maps;    /* # of 2 MB blocks mapped with one PDE. */
+
+bool vm_stat_on_exit;
+size_t stack_pregrow_pages = 4;
+
+/* Ticks between two working set samples of a process. */
+#define WS_SAMPLE_TICKS TIMER_FREQ
+
+/* Pages read ahead of a fault in a MADV_SEQUENTIAL area; the page this
+ * far behind the fault is evicted early. */
+#define READAHEAD_PAGES 8
+
+/* Most pages one MADV_WILLNEED call brings in.  The call reads them
+ * itself rather than handing them to a worker: the supplemental page
+ * table and the pml4 of a process are only changed by its own thread,
+ * so a worker would need locking on every fault path.  The cap bounds
+ * how long the call blocks. */
+#define WILLNEED_MAX_PAGES 256
+
+/* Ticks an allocation waits for the victim of the OOM killer to exit
+ * before it gives up its own process instead. */
+#define OOM_WAIT_TICKS 20
+
+static size_t oom_kills;   /* # of processes killed for want of memory. */
+
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 void
@@ -24,6 +63,22 @@ vm_init (void) {
 	/* DO NOT MODIFY UPPER LINES. */
 	/* TODO: Your code goes here. */
 	list_init(&frame_table);
+	zero_frame.kva = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+	zero_frame.page = NULL;
+	vm_share_init ();
+}
+
+/* Prints virtual memory statistics. */
+void
+vm_print_stats (void) {
+	printf ("VM: %zu frames saved by zero page sharing\n",
+			zero_page_maps - zero_page_copies);
+	printf ("VM: %zu 2 MB blocks mapped with large pages\n", large_page_maps);
+	printf ("VM: %zu processes killed out of memory\n", oom_kills);
+	vm_share_print_stats ();
+	shm_print_stats ();
+	zswap_print_stats ();
+	vm_file_print_stats ();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -76,6 +131,11 @@ static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
 static void spt_kill_destructor (struct hash_elem *h, void *aux UNUSED);
+static bool vm_map_zero_page (struct page *page);
+static void vm_do_sample_working_set (struct thread *t);
+static bool vm_try_large_fault (struct vma *vma, void *addr);
+static bool vm_stack_growth (struct vma *vma, void *upage);
+static void vm_advise_sequential (struct page *page);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -138,9 +198,10 @@ spt_insert_page (struct supplemental_page_table *spt UNUSED, struct page *page U
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
-	hash_delete(&thread_current()->spt.spt_hash, &page->hash_elem);
+	hash_delete(&spt->spt_hash, &page->hash_elem);
+	if (page->vma != NULL)
+		list_remove(&page->vma_elem);
 	vm_dealloc_page (page);
-	return true;
 }
 
 /* Get the struct frame, that will be evicted. */
@@ -157,34 +218,45 @@ vm_get_victim (void) {
 	while (true) {
 		struct frame *frame = list_entry(fte, struct frame, frame_elem);
 		struct page *page = frame->page;
+		uint64_t *pml4 = frame->owner->pml4;
 
-		if (!pml4_is_accessed(thread_current()->pml4, page->va)) {
+		if (!pml4_is_accessed(pml4, page->va)) {
 			victim = frame;
 			break;
 		} else {
-			pml4_set_accessed(thread_current()->pml4, page->va, false);
+			pml4_set_accessed(pml4, page->va, false);
+			fte = list_next(fte);
 			if (fte == list_end(&frame_table)) fte = list_begin(&frame_table);
-			else fte = list_next(fte);
 		}
 	}
 	return victim;
 }
 
-/* Evict one page and return the corresponding frame.
+/* Evict one page and return the corresponding frame.  A victim that
+ * cannot be swapped out, an anonymous page once swap is full, is passed
+ * over for the next one.
  * Return NULL on error.*/
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
+	struct frame *victim UNUSED = NULL;
+	struct page *page;
+	size_t tries;
 	/* TODO: swap out the victim and return the evicted frame. */
+	for (tries = list_size (&frame_table); tries > 0; tries--) {
+		victim = vm_get_victim ();
+		if (victim == NULL)
+			goto err;
+		page = victim->page;
+		if (swap_out(page))
+			break;
+		fte = list_next (&victim->frame_elem);
+		victim = NULL;
+	}
 	if (victim == NULL)
 		goto err;
 
-	struct page *page = victim->page;
-
-	if (!swap_out(page))
-		goto err;
-
-	pml4_clear_page(thread_current()->pml4, page->va);
+	pml4_clear_page(victim->owner->pml4, page->va);
+	victim->owner->spt.stats.evictions++;
 
 	victim->page = NULL;
 	page->frame = NULL;
@@ -196,28 +268,133 @@ err:
 	return NULL;
 }
 
+/* Set the OOM score of T to its pages in swap. */
+static void
+vm_oom_reset_score (struct thread *t, void *aux UNUSED) {
+	t->spt.oom_score = t->spt.swapped;
+}
+
+/* Remember T in *VICTIM_ if it is a user process with a larger OOM
+ * score. */
+static void
+vm_oom_pick (struct thread *t, void *victim_) {
+	struct thread **victim = victim_;
+
+	if (t->pml4 != NULL
+			&& (*victim == NULL || t->spt.oom_score > (*victim)->spt.oom_score))
+		*victim = t;
+}
+
+/* Returns the user process with the largest footprint, resident frames
+ * plus pages in swap, or NULL if there is none. */
+static struct thread *
+vm_oom_select (void) {
+	struct thread *victim = NULL;
+	struct list_elem *e;
+	enum intr_level old_level = intr_disable ();
+
+	thread_foreach (vm_oom_reset_score, NULL);
+	for (e = list_begin (&frame_table); e != list_end (&frame_table);
+			e = list_next (e)) {
+		struct frame *frame = list_entry (e, struct frame, frame_elem);
+		if (frame->owner != NULL)
+			frame->owner->spt.oom_score++;
+	}
+	thread_foreach (vm_oom_pick, &victim);
+	intr_set_level (old_level);
+	return victim;
+}
+
+/* Find a free frame once the user pool is empty.  Evicts a page if one
+ * can go; otherwise the OOM killer marks the process with the largest
+ * footprint, which exits at its next system call or fault, and the
+ * allocation waits for its frames.  If the current process is the
+ * largest, or the victim does not exit within OOM_WAIT_TICKS, the current
+ * process is marked instead and NULL is returned, so that the allocation
+ * fails and the process exits once it is back at the fault or system
+ * call boundary, holding no locks.  Returns the kernel address of the
+ * frame. */
+static void *
+vm_reclaim_frame (void) {
+	struct thread *curr = thread_current ();
+	int waited;
+
+	for (waited = 0; waited < OOM_WAIT_TICKS; waited++) {
+		struct frame *victim = vm_evict_frame ();
+		if (victim != NULL) {
+			void *kva = victim->kva;
+			free (victim);
+			return kva;
+		}
+
+		struct thread *t = vm_oom_select ();
+		if (t == NULL || t == curr)
+			break;
+		if (!t->spt.oom_killed) {
+			t->spt.oom_killed = true;
+			oom_kills++;
+		}
+		timer_sleep (1);
+
+		void *kva = palloc_get_page (PAL_USER | PAL_ZERO);
+		if (kva != NULL)
+			return kva;
+	}
+
+	if (!curr->spt.oom_killed) {
+		curr->spt.oom_killed = true;
+		oom_kills++;
+	}
+	return NULL;
+}
+
+/* Returns the memory pressure, one of VM_PRESSURE_*.  There is none
+ * while 1/8 of the user frames are free; beyond that the level follows
+ * the share of frames and swap slots together that is still free. */
+int
+vm_pressure (void) {
+	size_t free_frames, frames, free_slots, slots;
+
+	palloc_user_stats (&free_frames, &frames);
+	vm_anon_swap_stats (&free_slots, &slots);
+	if (free_frames * 8 >= frames)
+		return VM_PRESSURE_NONE;
+	if ((free_frames + free_slots) * 4 >= frames + slots)
+		return VM_PRESSURE_LOW;
+	if ((free_frames + free_slots) * 16 >= frames + slots)
+		return VM_PRESSURE_MEDIUM;
+	return VM_PRESSURE_CRITICAL;
+}
+
 /* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * and return it. That is, if the user pool memory is full, this function
+ * evicts the frame to get the available memory space.  Returns NULL if
+ * nothing can be evicted, in which case the current process has been
+ * marked by the OOM killer.  A free frame is picked to match the cache
+ * colour of user page VA, unless VA is NULL. */
 static struct frame *
-vm_get_frame (void) {
+vm_get_frame (void *va) {
 	struct frame *frame = NULL;
 	/* TODO: Fill this function. */
-	void *kva = palloc_get_page(PAL_USER | PAL_ZERO);
+	void *kva = va != NULL ? palloc_get_colored(PAL_USER | PAL_ZERO, va)
+		: palloc_get_page(PAL_USER | PAL_ZERO);
     if (kva == NULL) {
         // 메모리 부족 → evict 필요
-		struct frame *victim = vm_evict_frame();
-		if (victim == NULL)
-			PANIC("No frame to evict!");
-
-		kva = victim->kva;
-		free(victim);  // 회수한 frame 구조체 메모리 해제
+		kva = vm_reclaim_frame ();
+		if (kva == NULL)
+			return NULL;
 	}
 	
 	frame = (struct frame *)malloc(sizeof(struct frame));
+	if (frame == NULL) {
+		palloc_free_page (kva);
+		return NULL;
+	}
 	frame->kva = kva;
 	frame->page = NULL;
+	frame->owner = thread_current();
+	frame->share = NULL;
+	frame->shm = NULL;
 
 	list_push_back(&frame_table, &frame->frame_elem);  // frame table 등록
 
@@ -226,24 +403,56 @@ vm_get_frame (void) {
 	return frame;
 }
 
-/* Growing the stack. */
+/* Like vm_get_frame (), but the frame is kept off the frame table, so it
+ * is never chosen for eviction.  Returns NULL if no frame is left. */
+struct frame *
+vm_get_unevictable_frame (void) {
+	struct frame *frame = vm_get_frame (NULL);
+	if (frame == NULL)
+		return NULL;
+	if (fte == &frame->frame_elem)
+		fte = list_next (fte);
+	list_remove (&frame->frame_elem);
+	frame->owner = NULL;
+	return frame;
+}
+
+/* Release FRAME, which must already be unmapped, back to the user pool.
+ * The shared zero frame is never freed, a frame of shared anonymous memory
+ * only with its object, and a frame shared by processes only when its last
+ * user lets it go. */
+void
+vm_free_frame (struct frame *frame) {
+	if (frame == &zero_frame || frame->shm != NULL)
+		return;
+	if (frame->share != NULL) {
+		vm_share_release (frame);
+		return;
+	}
+	if (fte == &frame->frame_elem)
+		fte = list_next(fte);
+	list_remove(&frame->frame_elem);
+	palloc_free_page(frame->kva);
+	free(frame);
+}
+
+/* Growing the stack.  The stack area reserves everything down to
+ * STACK_LIMIT, so the faulting page is created by the caller like in any
+ * other area; here the stack_pregrow_pages pages below it are created and
+ * claimed as well, since a stack that grew this far will likely go on
+ * growing, and each of them would otherwise cost a fault of its own. */
 static bool
-vm_stack_growth (void *addr UNUSED) {
-	/* TODO: To implement stack growth functionalities, you first modify 
-	 * TODO: vm_try_handle_fault() to identify the stack growth.  
-	 * TODO: After identifying the stack growth, you should make a call 
-	 * TODO: to vm_stack_growth() to grow  the stack. */
-	/* Increases the stack size by allocating one or more anonymous pages
-	 * so that addr is no longer a faulted address. Make sure you round down
-	 * the addr to PGSIZE when handling the allocation. */
-	void *upage = pg_round_down(addr);
-	int cnt = 0;
-	while (!spt_find_page(&thread_current()->spt, upage + cnt * PGSIZE))
-		cnt++;
-	for (int i = 0; i < cnt; i++) {
-		if (!vm_alloc_page_with_initializer(VM_ANON | VM_MARKER_0, upage + i * PGSIZE, true, NULL, NULL))
-			return false;
-		if (!vm_claim_page(upage + i * PGSIZE))
+vm_stack_growth (struct vma *vma, void *upage) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+
+	for (size_t i = 1; i <= stack_pregrow_pages; i++) {
+		void *va = upage - i * PGSIZE;
+		struct page *page;
+
+		if (va < vma->start || spt_find_page (spt, va) != NULL)
+			break;
+		page = vma_populate (vma, va);
+		if (page == NULL || !vm_do_claim_page (page))
 			return false;
 	}
 	return true;
@@ -251,7 +460,156 @@ vm_stack_growth (void *addr UNUSED) {
 
 /* Handle the fault on write_protected page */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_handle_wp (struct page *page) {
+	/* Only a write to a page sharing the zero frame is resolved here; any
+	 * other write to a read-only page is a real protection violation. */
+	if (page->frame != &zero_frame || !page->writable)
+		return false;
+	if (!vm_page_make_private (page))
+		return false;
+	thread_current ()->spt.stats.cow_faults++;
+	return true;
+}
+
+/* Returns true if bringing PAGE into memory reads the swap disk or a
+ * file. */
+static bool
+vm_fault_needs_io (struct page *page) {
+	switch (page->operations->type) {
+		case VM_UNINIT:
+			return page->vma != NULL
+				&& (size_t) (page->va - page->vma->start) < page->vma->read_bytes;
+		case VM_ANON:
+			return page->anon.slot_idx != BITMAP_ERROR;
+		default:
+			return page->file.read_bytes > 0;
+	}
+}
+
+/* Returns true if PAGE is an anonymous page that was never touched, so its
+ * contents are known to be all zeros. */
+static bool
+vm_is_fresh_anon (struct page *page) {
+	if (page->operations->type != VM_UNINIT
+			|| VM_TYPE (page->uninit.type) != VM_ANON)
+		return false;
+	if (page->vma != NULL)
+		return vma_is_zero_fill (page->vma, page->va);
+	return page->uninit.init == NULL;
+}
+
+/* Map the shared zero frame read-only at the fresh anonymous PAGE. */
+static bool
+vm_map_zero_page (struct page *page) {
+	struct uninit_page *uninit = &page->uninit;
+
+	if (!uninit->page_initializer (page, uninit->type, zero_frame.kva))
+		return false;
+	page->frame = &zero_frame;
+	if (!pml4_set_page (thread_current ()->pml4, page->va, zero_frame.kva, false))
+		return false;
+	zero_page_maps++;
+	return true;
+}
+
+/* Give PAGE a private frame if it shares the zero frame, so that it can be
+ * written.  Returns true if PAGE is (now) backed by its own frame. */
+bool
+vm_page_make_private (struct page *page) {
+	uint64_t *pml4 = thread_current ()->pml4;
+
+	if (page->frame != &zero_frame)
+		return true;
+
+	struct frame *frame = vm_get_frame (page->va);
+	if (frame == NULL)
+		return false;
+	memset (frame->kva, 0, PGSIZE);
+	frame->page = page;
+	page->frame = frame;
+
+	pml4_clear_page (pml4, page->va);
+	if (!pml4_set_page (pml4, page->va, frame->kva, page->writable))
+		return false;
+	zero_page_copies++;
+	return true;
+}
+
+/* Back the whole 2 MB block around ADDR with one large page, if the block
+ * lies inside VMA, is writable zero filled anonymous memory that was never
+ * touched, and 2 MB of aligned free frames are available.  Each 4 kB page
+ * still gets its own struct page and frame, so eviction and teardown work
+ * as usual; the MMU splits the mapping when one of them is changed.
+ * Returns false, having changed nothing, if any of this does not hold. */
+static bool
+vm_try_large_fault (struct vma *vma, void *addr) {
+	struct thread *t = thread_current ();
+	void *block = (void *) ROUND_DOWN ((uint64_t) addr, LARGE_PGSIZE);
+	const size_t cnt = LARGE_PGSIZE / PGSIZE;
+	struct frame *frame;
+	struct page *page;
+	uint8_t *kva;
+	size_t i, done;
+
+	if (!vma->writable || vma->shm != NULL || block < vma->start
+			|| block + LARGE_PGSIZE > vma->end || !vma_is_zero_fill (vma, block))
+		return false;
+	for (i = 0; i < cnt; i++)
+		if (spt_find_page (&t->spt, block + i * PGSIZE) != NULL)
+			return false;
+
+	kva = palloc_get_large (PAL_USER | PAL_ZERO);
+	if (kva == NULL)
+		return false;
+	/* The frame rides on the still uninitialized page until all exist. */
+	for (done = 0; done < cnt; done++) {
+		frame = malloc (sizeof *frame);
+		if (frame == NULL)
+			goto undo;
+		page = vma_populate (vma, block + done * PGSIZE);
+		if (page == NULL) {
+			free (frame);
+			goto undo;
+		}
+		page->frame = frame;
+	}
+
+	/* Map the block before the pages come to life, so that a failure
+	 * here can still be undone.  Without a large mapping each page is
+	 * mapped on its own. */
+	if (pml4_set_large_page (t->pml4, block, kva, true))
+		large_page_maps++;
+	else
+		for (i = 0; i < cnt; i++)
+			if (!pml4_set_page (t->pml4, block + i * PGSIZE, kva + i * PGSIZE,
+						true)) {
+				pml4_clear_range (t->pml4, block, block + i * PGSIZE);
+				goto undo;
+			}
+
+	for (i = 0; i < cnt; i++) {
+		page = spt_find_page (&t->spt, block + i * PGSIZE);
+		frame = page->frame;
+		page->uninit.page_initializer (page, page->uninit.type, kva + i * PGSIZE);
+		frame->kva = kva + i * PGSIZE;
+		frame->page = page;
+		frame->owner = t;
+		frame->share = NULL;
+		frame->shm = NULL;
+		page->frame = frame;
+		list_push_back (&frame_table, &frame->frame_elem);
+	}
+	return true;
+
+undo:
+	for (i = 0; i < done; i++) {
+		page = spt_find_page (&t->spt, block + i * PGSIZE);
+		free (page->frame);
+		page->frame = NULL;
+		spt_remove_page (&t->spt, page);
+	}
+	palloc_free_multiple (kva, cnt);
+	return false;
 }
 
 /* Return true on success */
@@ -262,23 +620,251 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED, bool user U
 	/* TODO: Your code goes here */
 	/* Modify this function to resolve the page struct corresponding to the faulted address
 	 * by consulting to the supplemental page table through spt_find_page. */
-    if (addr == NULL || is_kernel_vaddr(addr) || !not_present)
+    if (addr == NULL || is_kernel_vaddr(addr))
+		return false;
+	if (user && spt->oom_killed)
 		return false;
+	vm_sample_working_set();
 	struct page *page = spt_find_page(spt, addr);
+	if (!not_present) {
+		if (!write || page == NULL || !vm_handle_wp(page))
+			return false;
+		spt->stats.minor_faults++;
+		return true;
+	}
     if (page == NULL) {
-		/* If you have confirmed that the fault can be handled with a stack growth,
-		 * call vm_stack_growth with the faulted address. */
-		void *rsp = thread_current()->stack_pointer;
-		if (rsp - PGSIZE < addr && addr < USER_STACK && rsp - PGSIZE >= STACK_LIMIT) {
-			if (!vm_stack_growth(addr))
+		struct vma *vma = vma_find(spt, addr);
+		/* A fault in the kernel comes from a system call, which saved the
+		 * user stack pointer on entry. */
+		void *rsp = user ? (void *) f->rsp : thread_current()->stack_pointer;
+		if (vma != NULL && vma_is_stack(vma)) {
+			/* Below the stack pointer only a push may touch memory. */
+			if (addr <= rsp - PGSIZE)
+				return false;
+			page = vma_populate(vma, addr);
+			if (page == NULL || !vm_stack_growth(vma, page->va))
+				return false;
+			spt->stats.stack_faults++;
+		} else if (vma != NULL) {
+			if (write && vma->advice != MADV_RANDOM
+					&& vm_try_large_fault(vma, addr)) {
+				spt->stats.minor_faults++;
+				return true;
+			}
+			/* First touch inside a mapped area: create the page now. */
+			page = vma_populate(vma, addr);
+			if (page == NULL)
 				return false;
-			page = spt_find_page(spt, addr);
 		} else
 			return false;
 	}
 	if (write && !page->writable)
 		return false;
-    return vm_do_claim_page(page);
+	if (page->vma != NULL && page->vma->shm != NULL
+			&& page->operations->type == VM_UNINIT) {
+		spt->stats.minor_faults++;
+		return shm_claim(page);
+	}
+	if (vm_share_candidate(page))
+		return vm_share_claim(page);
+	if (vm_fault_needs_io(page))
+		spt->stats.major_faults++;
+	else
+		spt->stats.minor_faults++;
+	if (!write && vm_is_fresh_anon(page))
+		return vm_map_zero_page(page);
+	if (!vm_do_claim_page(page))
+		return false;
+	if (page->vma != NULL && page->vma->advice == MADV_SEQUENTIAL)
+		vm_advise_sequential(page);
+	return true;
+}
+
+/* Bring the page of VMA at VA into memory ahead of its first access,
+ * unless it is resident already or would only hold zeros.  The page is
+ * claimed the way vm_try_handle_fault would, so a page of a shared area
+ * maps the frame of its shm object. */
+static bool
+vm_prefetch_page (struct vma *vma, void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
+
+	if (page == NULL) {
+		if (vma_is_zero_fill (vma, va))
+			return true;
+		page = vma_populate (vma, va);
+		if (page == NULL)
+			return false;
+	} else if (page->frame != NULL)
+		return true;
+	if (page->vma != NULL && page->vma->shm != NULL
+			&& page->operations->type == VM_UNINIT)
+		return shm_claim (page);
+	if (vm_share_candidate (page))
+		return vm_share_claim (page);
+	return vm_do_claim_page (page);
+}
+
+/* Make the frame of PAGE the next one the clock hand looks at, with its
+ * accessed bit clear, so that it is the next to be evicted. */
+static void
+vm_drop_behind (struct page *page) {
+	struct frame *frame = page->frame;
+
+	if (frame == NULL || frame->owner != thread_current ())
+		return;
+	pml4_set_accessed (frame->owner->pml4, page->va, false);
+	if (fte == &frame->frame_elem)
+		return;
+	list_remove (&frame->frame_elem);
+	if (fte == NULL || fte == list_end (&frame_table))
+		fte = list_begin (&frame_table);
+	list_insert (fte, &frame->frame_elem);
+	fte = &frame->frame_elem;
+}
+
+/* After PAGE of a MADV_SEQUENTIAL area was faulted in, read the next
+ * READAHEAD_PAGES pages of the area and evict the one that many pages
+ * behind first. */
+static void
+vm_advise_sequential (struct page *page) {
+	struct vma *vma = page->vma;
+	uint64_t *pml4 = thread_current ()->pml4;
+	void *va;
+	int i;
+
+	/* The faulting page is not accessed yet; keep the read ahead from
+	 * evicting it before the access is retried. */
+	pml4_set_accessed (pml4, page->va, true);
+	for (i = 1; i <= READAHEAD_PAGES; i++) {
+		va = page->va + i * PGSIZE;
+		if (va >= vma->end || !vm_prefetch_page (vma, va))
+			break;
+	}
+
+	va = page->va - READAHEAD_PAGES * PGSIZE;
+	if (va >= vma->start && va < page->va) {
+		struct page *behind = spt_find_page (&thread_current ()->spt, va);
+		if (behind != NULL)
+			vm_drop_behind (behind);
+	}
+}
+
+/* Destroy the pages of the current process in [START, END), which lies
+ * in mapped areas, and unmap the range.  Dirty file pages are written
+ * back and swap slots freed; the next access faults the page in afresh
+ * from the area, as zeros or from its file. */
+static void
+vm_dontneed (void *start, void *end) {
+	struct thread *t = thread_current ();
+	struct list_elem *e;
+	void *va;
+
+	for (va = start; va < end; ) {
+		struct vma *vma = vma_find (&t->spt, va);
+		for (e = list_begin (&vma->pages); e != list_end (&vma->pages); ) {
+			struct page *page = list_entry (e, struct page, vma_elem);
+			e = list_next (e);
+			if (start <= page->va && page->va < end)
+				spt_remove_page (&t->spt, page);
+		}
+		va = vma->end;
+	}
+	pml4_clear_range (t->pml4, start, end);
+}
+
+/* Apply ADVICE, one of MADV_*, to the LENGTH bytes at ADDR of the current
+ * process.  ADDR must be page aligned and every page of the range must
+ * be mapped.  The paging hints apply to every area the range touches. */
+bool
+vm_madvise (void *addr, size_t length, int advice) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *vma;
+	void *start = addr, *end, *va;
+	size_t cnt;
+
+	if (start == NULL || pg_ofs (start) != 0 || !is_user_vaddr (start)
+			|| length == 0 || length > (size_t) (KERN_BASE - (uint64_t) start))
+		return false;
+	end = pg_round_up (start + length);
+	for (va = start; va < end; va = vma->end)
+		if ((vma = vma_find (spt, va)) == NULL)
+			return false;
+
+	switch (advice) {
+		case MADV_NORMAL:
+		case MADV_RANDOM:
+		case MADV_SEQUENTIAL:
+			for (va = start; va < end; va = vma->end) {
+				vma = vma_find (spt, va);
+				vma->advice = advice;
+			}
+			return true;
+		case MADV_WILLNEED:
+			for (va = start, cnt = 0; va < end && cnt < WILLNEED_MAX_PAGES;
+					va += PGSIZE, cnt++)
+				if (!vm_prefetch_page (vma_find (spt, va), va))
+					return false;
+			return true;
+		case MADV_DONTNEED:
+			vm_dontneed (start, end);
+			return true;
+		default:
+			return false;
+	}
+}
+
+/* Sample the working set of the current process if WS_SAMPLE_TICKS have
+ * passed since its last sample.  Called on faults and system calls. */
+void
+vm_sample_working_set (void) {
+	struct thread *t = thread_current ();
+	if (t->pml4 != NULL
+			&& timer_elapsed (t->spt.ws_sampled_at) >= WS_SAMPLE_TICKS)
+		vm_do_sample_working_set (t);
+}
+
+/* Count the resident pages of T and those accessed since the previous
+ * sample, then clear the accessed bits to start the next interval. */
+static void
+vm_do_sample_working_set (struct thread *t) {
+	struct supplemental_page_table *spt = &t->spt;
+	struct hash_iterator i;
+	size_t resident = 0, accessed = 0;
+
+	hash_first (&i, &spt->spt_hash);
+	while (hash_next (&i)) {
+		struct page *page = hash_entry (hash_cur (&i), struct page, hash_elem);
+		if (page->frame == NULL)
+			continue;
+		resident++;
+		if (pml4_is_accessed (t->pml4, page->va)) {
+			accessed++;
+			pml4_set_accessed (t->pml4, page->va, false);
+		}
+	}
+	spt->stats.resident = resident;
+	spt->stats.working_set = accessed;
+	spt->ws_sampled_at = timer_ticks ();
+}
+
+/* Copy the paging statistics of the current process into STAT. */
+void
+vm_get_stats (struct vmstat *stat) {
+	vm_sample_working_set ();
+	*stat = thread_current ()->spt.stats;
+}
+
+/* Print the paging statistics of the current process. */
+void
+vm_print_process_stats (void) {
+	struct thread *t = thread_current ();
+	const struct vmstat *s = &t->spt.stats;
+
+	printf ("%s: vmstat(minor %"PRIu64", major %"PRIu64", stack %"PRIu64
+			", cow %"PRIu64", evicted %"PRIu64", resident %"PRIu64
+			", ws %"PRIu64")\n", t->name, s->minor_faults, s->major_faults,
+			s->stack_faults, s->cow_faults, s->evictions, s->resident,
+			s->working_set);
 }
 
 /* Free the page.
@@ -304,7 +890,7 @@ vm_claim_page (void *va UNUSED) {
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	struct frame *frame = vm_get_frame (page->va);
 	if (frame == NULL)
 		return false;
 
@@ -324,11 +910,18 @@ vm_do_claim_page (struct page *page) {
 void
 supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
 	hash_init (&spt->spt_hash, page_hash, page_less, NULL);
+	vma_init (spt);
+	memset (&spt->stats, 0, sizeof spt->stats);
+	spt->ws_sampled_at = timer_ticks ();
+	spt->swapped = 0;
 }
 
 /* Copy supplemental page table from src to dst */
 bool
 supplemental_page_table_copy (struct supplemental_page_table *dst, struct supplemental_page_table *src) {
+	if (!vma_copy (dst, src))
+		return false;
+
     struct hash_iterator i;
     hash_first(&i, &src->spt_hash);
     while (hash_next(&i)) {
@@ -336,26 +929,47 @@ supplemental_page_table_copy (struct supplemental_page_table *dst, struct supple
         enum vm_type type = src_page->operations->type;
         void *va = src_page->va;
         bool writable = src_page->writable;
+		struct vma *vma = src_page->vma != NULL ? vma_find(dst, va) : NULL;
         if (type == VM_UNINIT) {
+			/* The child faults it in from its own copy of the area. */
+			if (vma != NULL)
+				continue;
 			if (!vm_alloc_page_with_initializer(src_page->uninit.type, va, writable, src_page->uninit.init, src_page->uninit.aux))
                 return false;
             continue;
-		} else if (type == VM_FILE) {
-			struct lazy_load_args *lla = (struct lazy_load_args *)malloc(sizeof(struct lazy_load_args));
-			lla->file = src_page->file.file;
-			lla->ofs = src_page->file.ofs;
-			lla->read_bytes = src_page->file.read_bytes;
-			lla->zero_bytes = src_page->file.zero_bytes;
-			if (!vm_alloc_page_with_initializer(type, va, writable, NULL, lla))
+		}
+		/* A page still sharing the zero frame keeps sharing it. */
+		if (src_page->frame == &zero_frame) {
+			if (!vm_alloc_page_with_initializer(type, va, writable, NULL, NULL))
+				return false;
+			struct page *dst_page = spt_find_page(dst, va);
+			if (vma != NULL)
+				vma_attach_page(vma, dst_page);
+			if (!vm_map_zero_page(dst_page))
 				return false;
-			struct page *file_page = spt_find_page(dst, va);
-			file_backed_initializer(file_page, type, NULL);
-			pml4_set_page(thread_current()->pml4, file_page->va, src_page->frame->kva, src_page->writable);
 			continue;
 		}
+		/* Shared anonymous memory is mapped again on the child's first
+		 * fault, from the object its copy of the area refers to. */
+		if (src_page->vma != NULL && src_page->vma->shm != NULL)
+			continue;
+		/* A shared text page is mapped again on the child's first fault. */
+		if (src_page->frame != NULL && src_page->frame->share != NULL)
+			continue;
+		/* An evicted file page is read back from the file on demand. */
+		if (type == VM_FILE && src_page->frame == NULL)
+			continue;
 		if (!vm_alloc_page_with_initializer(type, va, writable, NULL, NULL) || !vm_claim_page(va))
             return false;
         struct page *dst_page = spt_find_page(dst, va);
+		if (vma != NULL)
+			vma_attach_page(vma, dst_page);
+		if (type == VM_FILE) {
+			dst_page->file.file = vma->file;
+			dst_page->file.ofs = src_page->file.ofs;
+			dst_page->file.read_bytes = src_page->file.read_bytes;
+			dst_page->file.zero_bytes = src_page->file.zero_bytes;
+		}
         memcpy(dst_page->frame->kva, src_page->frame->kva, PGSIZE);
     }
     return true;
@@ -366,7 +980,15 @@ void
 supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
 	/* TODO: Destroy all the supplemental_page_table hold by thread and
 	 * TODO: writeback all the modified contents to the storage. */
+	/* Dirty file pages go back in large runs before the pages die. */
+	if (thread_current()->pml4 != NULL)
+		file_sync_all();
 	hash_clear(&spt->spt_hash, spt_kill_destructor);
+	vma_kill(spt);
+	/* Unmap the whole user half of the address space in one pass. */
+	if (thread_current()->pml4 != NULL)
+		pml4_clear_range(thread_current()->pml4, NULL,
+				(void *) (1UL << PML4SHIFT));
 }
 
 static void spt_kill_destructor (struct hash_elem *h, void *aux UNUSED) {
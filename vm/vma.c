@@ -0,0 +1,230 @@
+/* vma.c: Virtual memory areas.
+ *
+ * A process's address space is described by a short list of areas sorted by
+ * start address.  Mapping an executable segment or a file only records the
+ * area here; the per page `struct page' is created by vma_populate () on the
+ * first fault inside the area, so large mappings cost O(1) to set up and
+ * untouched parts of them cost no memory. */
+
+#include "vm/vma.h"
+#include "vm/vm.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
+#include "filesys/file.h"
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+static bool vma_lazy_load (struct page *page, void *aux);
+
+static bool
+vma_less (const struct list_elem *a_, const struct list_elem *b_,
+		void *aux UNUSED) {
+	const struct vma *a = list_entry (a_, struct vma, elem);
+	const struct vma *b = list_entry (b_, struct vma, elem);
+	return a->start < b->start;
+}
+
+/* Initialize the area list of SPT. */
+void
+vma_init (struct supplemental_page_table *spt) {
+	list_init (&spt->vmas);
+	spt->vma_cache = NULL;
+}
+
+/* Returns true if [START, START + LENGTH) intersects any area of SPT. */
+bool
+vma_overlaps (struct supplemental_page_table *spt, void *start,
+		size_t length) {
+	void *end = pg_round_up (start + length);
+	struct list_elem *e;
+
+	for (e = list_begin (&spt->vmas); e != list_end (&spt->vmas);
+			e = list_next (e)) {
+		struct vma *vma = list_entry (e, struct vma, elem);
+		if (vma->start >= end)
+			break;
+		if (start < vma->end)
+			return true;
+	}
+	return false;
+}
+
+/* Create an area of LENGTH bytes (rounded up to pages) at START.
+ * The first READ_BYTES bytes are read from FILE starting at OFS, and the
+ * rest is zero filled.  FILE is reopened, so the caller keeps its own
+ * handle.  Returns NULL if the range is invalid, overlaps an existing
+ * area, or memory runs out. */
+struct vma *
+vma_insert (struct supplemental_page_table *spt, void *start, size_t length,
+		enum vm_type type, bool writable, struct file *file, off_t ofs,
+		size_t read_bytes) {
+	ASSERT (VM_TYPE (type) != VM_UNINIT);
+
+	if (start == NULL || pg_ofs (start) != 0 || length == 0)
+		return NULL;
+	if (!is_user_vaddr (start) || !is_user_vaddr (start + length - 1))
+		return NULL;
+	if (vma_overlaps (spt, start, length))
+		return NULL;
+
+	struct vma *vma = malloc (sizeof *vma);
+	if (vma == NULL)
+		return NULL;
+
+	vma->start = start;
+	vma->end = pg_round_up (start + length);
+	vma->type = type;
+	vma->writable = writable;
+	vma->file = NULL;
+	vma->ofs = ofs;
+	vma->read_bytes = file != NULL ? read_bytes : 0;
+	vma->advice = MADV_NORMAL;
+	vma->mapped = false;
+	vma->shm = NULL;
+	list_init (&vma->pages);
+
+	if (file != NULL) {
+		vma->file = file_reopen (file);
+		if (vma->file == NULL) {
+			free (vma);
+			return NULL;
+		}
+	}
+
+	list_insert_ordered (&spt->vmas, &vma->elem, vma_less, NULL);
+	return vma;
+}
+
+/* Returns the area of SPT that contains VA, or NULL. */
+struct vma *
+vma_find (struct supplemental_page_table *spt, const void *va) {
+	struct vma *vma = spt->vma_cache;
+	struct list_elem *e;
+
+	if (vma != NULL && vma->start <= va && va < vma->end)
+		return vma;
+
+	for (e = list_begin (&spt->vmas); e != list_end (&spt->vmas);
+			e = list_next (e)) {
+		vma = list_entry (e, struct vma, elem);
+		if (vma->start > va)
+			break;
+		if (va < vma->end) {
+			spt->vma_cache = vma;
+			return vma;
+		}
+	}
+	return NULL;
+}
+
+/* Returns true if the page of VMA at VA is anonymous and lies entirely
+ * past the file backed part of the area, i.e. starts out as zeros. */
+bool
+vma_is_zero_fill (struct vma *vma, const void *va) {
+	size_t page_ofs = pg_round_down (va) - vma->start;
+	return VM_TYPE (vma->type) == VM_ANON && page_ofs >= vma->read_bytes;
+}
+
+/* Link PAGE, which lies inside VMA, to the area. */
+void
+vma_attach_page (struct vma *vma, struct page *page) {
+	page->vma = vma;
+	list_push_back (&vma->pages, &page->vma_elem);
+}
+
+/* Create the pending page of VMA that covers VA.  The page is filled by
+ * vma_lazy_load () when it is claimed.  Returns NULL on failure. */
+struct page *
+vma_populate (struct vma *vma, void *va) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *upage = pg_round_down (va);
+
+	ASSERT (vma->start <= upage && upage < vma->end);
+
+	if (!vm_alloc_page_with_initializer (vma->type, upage, vma->writable,
+				vma_lazy_load, vma))
+		return NULL;
+
+	struct page *page = spt_find_page (spt, upage);
+	vma_attach_page (vma, page);
+	return page;
+}
+
+/* Initializer of the pages born in an area.  Reads the part of the page
+ * backed by the area's file and zeros the rest. */
+static bool
+vma_lazy_load (struct page *page, void *aux) {
+	struct vma *vma = aux;
+	size_t page_ofs = page->va - vma->start;
+	size_t read_bytes = 0;
+	void *kva = page->frame->kva;
+
+	if (page_ofs < vma->read_bytes)
+		read_bytes = MIN (vma->read_bytes - page_ofs, PGSIZE);
+
+	if (read_bytes > 0 && file_read_at (vma->file, kva, read_bytes,
+				vma->ofs + page_ofs) != (off_t) read_bytes)
+		return false;
+	memset (kva + read_bytes, 0, PGSIZE - read_bytes);
+
+	if (page_get_type (page) == VM_FILE) {
+		page->file.file = vma->file;
+		page->file.ofs = vma->ofs + page_ofs;
+		page->file.read_bytes = read_bytes;
+		page->file.zero_bytes = PGSIZE - read_bytes;
+	}
+	return true;
+}
+
+/* Destroy every page of VMA, unmap the whole range at once, then free the
+ * area itself. */
+void
+vma_remove (struct supplemental_page_table *spt, struct vma *vma) {
+	while (!list_empty (&vma->pages)) {
+		struct page *page = list_entry (list_front (&vma->pages),
+				struct page, vma_elem);
+		spt_remove_page (spt, page);
+	}
+	pml4_clear_range (thread_current ()->pml4, vma->start, vma->end);
+
+	list_remove (&vma->elem);
+	if (spt->vma_cache == vma)
+		spt->vma_cache = NULL;
+	file_close (vma->file);
+	shm_close (vma->shm);
+	free (vma);
+}
+
+/* Duplicate the areas of SRC into DST, for fork. */
+bool
+vma_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct list_elem *e;
+
+	for (e = list_begin (&src->vmas); e != list_end (&src->vmas);
+			e = list_next (e)) {
+		struct vma *vma = list_entry (e, struct vma, elem);
+		struct vma *copy = vma_insert (dst, vma->start, vma->end - vma->start,
+				vma->type, vma->writable, vma->file, vma->ofs, vma->read_bytes);
+		if (copy == NULL)
+			return false;
+		copy->advice = vma->advice;
+		copy->mapped = vma->mapped;
+		copy->shm = shm_reopen (vma->shm);
+	}
+	return true;
+}
+
+/* Free every area of SPT.  The pages must already be destroyed. */
+void
+vma_kill (struct supplemental_page_table *spt) {
+	while (!list_empty (&spt->vmas)) {
+		struct vma *vma = list_entry (list_pop_front (&spt->vmas),
+				struct vma, elem);
+		file_close (vma->file);
+		shm_close (vma->shm);
+		free (vma);
+	}
+	spt->vma_cache = NULL;
+}
@@ -0,0 +1,230 @@
+/* zswap.c: Compressed in-memory tier in front of the swap disk.
+ *
+ * An evicted anonymous page is first offered to this tier.  A page whose
+ * 8 byte words are all equal (most often all zeros) is kept as that single
+ * word; any other page is compressed with a small LZ77 coder and kept if
+ * it shrinks to at most ZSWAP_MAX_LEN bytes.  Entries live in the kernel
+ * heap on an LRU list, and once they use more than zswap_budget bytes the
+ * coldest ones are written back to the swap disk by anon.c.
+ *
+ * The caller serializes every call with the swap lock. */
+
+#include "vm/zswap.h"
+#include <list.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+
+/* A compressed page. */
+struct zswap_entry {
+	struct page *page;          /* Page whose contents this holds. */
+	size_t len;                 /* Bytes in DATA, 0 if same filled. */
+	uint64_t fill;              /* Word repeated over a same filled page. */
+	struct list_elem elem;      /* Element of lru, coldest first. */
+	uint8_t data[];             /* Compressed contents. */
+};
+
+/* Largest compressed size worth keeping.  Entries are sized to fit in a
+ * 1 kB malloc block, so every kept page saves at least 3/4 of a frame. */
+#define ZSWAP_MAX_LEN (1024 - sizeof (struct zswap_entry))
+
+size_t zswap_budget = 512 * 1024;
+
+static struct list lru;
+static size_t zswap_used;           /* Heap bytes held by entries. */
+
+static size_t same_filled_cnt;      /* # of pages stored as one word. */
+static size_t compressed_cnt;       /* # of pages stored compressed. */
+static size_t rejected_cnt;         /* # of pages that went to disk. */
+static size_t writeback_cnt;        /* # of entries written back. */
+
+/* LZ77 coder.  Output is a sequence of groups: one control byte whose
+ * bits, LSB first, tell whether each of the next 8 items is a literal
+ * byte (0) or a 2 byte match (1) of 6 bits LENGTH - LZ_MIN_MATCH and
+ * 10 bits OFFSET - 1 back into the output. */
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (63 + LZ_MIN_MATCH)
+#define LZ_WINDOW 1024
+#define LZ_HASH_BITS 10
+
+static uint16_t lz_hash[1 << LZ_HASH_BITS];   /* Last position + 1. */
+static uint8_t lz_out[ZSWAP_MAX_LEN];
+
+static unsigned
+lz_hash_at (const uint8_t *p) {
+	uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Compresses the page at SRC into DST of CAP bytes.  Returns the
+ * compressed length, or 0 if it does not fit. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t cap) {
+	size_t in = 0, out = 0, ctl = 0;
+	int bit = 8;
+
+	memset (lz_hash, 0, sizeof lz_hash);
+	while (in < PGSIZE) {
+		if (bit == 8) {
+			/* Room for a control byte and 8 matches. */
+			if (out + 1 + 2 * 8 > cap)
+				return 0;
+			ctl = out++;
+			dst[ctl] = 0;
+			bit = 0;
+		}
+
+		if (in + LZ_MIN_MATCH <= PGSIZE) {
+			unsigned h = lz_hash_at (src + in);
+			size_t cand = lz_hash[h];
+			lz_hash[h] = in + 1;
+
+			if (cand != 0 && in - --cand <= LZ_WINDOW
+					&& !memcmp (src + cand, src + in, LZ_MIN_MATCH)) {
+				size_t off = in - cand;
+				size_t len = LZ_MIN_MATCH;
+				while (len < LZ_MAX_MATCH && in + len < PGSIZE
+						&& src[cand + len] == src[in + len])
+					len++;
+
+				dst[ctl] |= 1 << bit++;
+				dst[out++] = ((len - LZ_MIN_MATCH) << 2) | ((off - 1) >> 8);
+				dst[out++] = (off - 1) & 0xff;
+				in += len;
+				continue;
+			}
+		}
+		dst[out++] = src[in++];
+		bit++;
+	}
+	return out;
+}
+
+/* Expands the output of lz_compress () at SRC into the page at DST. */
+static void
+lz_decompress (const uint8_t *src, uint8_t *dst) {
+	size_t in = 0, out = 0;
+	uint8_t ctl = 0;
+	int bit = 8;
+
+	while (out < PGSIZE) {
+		if (bit == 8) {
+			ctl = src[in++];
+			bit = 0;
+		}
+		if (ctl & (1 << bit++)) {
+			size_t len = (src[in] >> 2) + LZ_MIN_MATCH;
+			size_t off = (((src[in] & 3) << 8) | src[in + 1]) + 1;
+			in += 2;
+			for (; len > 0; len--, out++)
+				dst[out] = dst[out - off];
+		} else
+			dst[out++] = src[in++];
+	}
+}
+
+/* Returns true if every word of the page at KVA equals its first. */
+static bool
+is_same_filled (const void *kva) {
+	const uint64_t *w = kva;
+	size_t i;
+
+	for (i = 1; i < PGSIZE / sizeof *w; i++)
+		if (w[i] != w[0])
+			return false;
+	return true;
+}
+
+/* Initializes the compressed tier. */
+void
+zswap_init (void) {
+	list_init (&lru);
+}
+
+/* Stores the contents of PAGE, found at KVA, in the tier.  Returns the new
+ * entry, or NULL if the page should go to the swap disk instead. */
+struct zswap_entry *
+zswap_store (struct page *page, const void *kva) {
+	struct zswap_entry *entry;
+	size_t len = 0;
+
+	if (zswap_budget == 0)
+		return NULL;
+
+	if (!is_same_filled (kva)) {
+		len = lz_compress (kva, lz_out, ZSWAP_MAX_LEN);
+		if (len == 0) {
+			rejected_cnt++;
+			return NULL;
+		}
+	}
+
+	entry = malloc (sizeof *entry + len);
+	if (entry == NULL) {
+		rejected_cnt++;
+		return NULL;
+	}
+	entry->page = page;
+	entry->len = len;
+	entry->fill = *(const uint64_t *) kva;
+	memcpy (entry->data, lz_out, len);
+	list_push_back (&lru, &entry->elem);
+	zswap_used += sizeof *entry + len;
+
+	if (len == 0)
+		same_filled_cnt++;
+	else
+		compressed_cnt++;
+	return entry;
+}
+
+/* Restores the page held by ENTRY into KVA.  ENTRY stays valid. */
+void
+zswap_load (struct zswap_entry *entry, void *kva) {
+	if (entry->len == 0) {
+		uint64_t *w = kva;
+		size_t i;
+
+		for (i = 0; i < PGSIZE / sizeof *w; i++)
+			w[i] = entry->fill;
+	} else
+		lz_decompress (entry->data, kva);
+}
+
+/* Drops ENTRY from the tier. */
+void
+zswap_free (struct zswap_entry *entry) {
+	list_remove (&entry->elem);
+	zswap_used -= sizeof *entry + entry->len;
+	free (entry);
+}
+
+/* Returns true if the tier holds more than its budget. */
+bool
+zswap_over_budget (void) {
+	return zswap_used > zswap_budget;
+}
+
+/* Removes the coldest entry, restoring its contents into KVA, and returns
+ * the page it belonged to so that the caller can write it to disk. */
+struct page *
+zswap_evict (void *kva) {
+	struct zswap_entry *entry = list_entry (list_front (&lru),
+			struct zswap_entry, elem);
+	struct page *page = entry->page;
+
+	zswap_load (entry, kva);
+	zswap_free (entry);
+	writeback_cnt++;
+	return page;
+}
+
+/* Prints compressed swap statistics. */
+void
+zswap_print_stats (void) {
+	printf ("Swap: %zu same-filled, %zu compressed, %zu to disk, "
+			"%zu written back\n", same_filled_cnt, compressed_cnt,
+			rejected_cnt, writeback_cnt);
+}